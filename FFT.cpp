@@ -0,0 +1,51 @@
+#include "FFT.hpp"
+#include "mix_kernels.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+FFT::FFT(uint32_t size_) : size(size_) {
+	bool power_of_four = (size >= 4 && (size & (size - 1)) == 0 && (size & 0x55555555u) != 0);
+	if (!power_of_four) throw std::runtime_error("FFT size " + std::to_string(size) + " is not a power of four.");
+
+	//pass with sub-transform length n has quarter = n / 4 and twiddles wk[p] = exp(-2 pi i k p / n):
+	for (uint32_t n = size; n >= 4; n /= 4) {
+		uint32_t quarter = n / 4;
+		for (uint32_t k = 1; k <= 3; ++k) {
+			for (uint32_t p = 0; p < quarter; ++p) {
+				double angle = -2.0 * 3.14159265358979323846 * double(k * p) / double(n);
+				twiddle_re.emplace_back(float(std::cos(angle)));
+				twiddle_im.emplace_back(float(std::sin(angle)));
+			}
+		}
+	}
+
+	scratch_re.resize(size);
+	scratch_im.resize(size);
+}
+
+void FFT::forward(float *re, float *im) {
+	float *x_re = re, *x_im = im;
+	float *y_re = scratch_re.data(), *y_im = scratch_im.data();
+	float const *w_re = twiddle_re.data(), *w_im = twiddle_im.data();
+	for (uint32_t n = size, stride = 1; n >= 4; n /= 4, stride *= 4) {
+		uint32_t quarter = n / 4;
+		fft_radix4_pass(x_re, x_im, y_re, y_im, quarter, stride, w_re, w_im);
+		w_re += 3 * quarter;
+		w_im += 3 * quarter;
+		std::swap(x_re, y_re);
+		std::swap(x_im, y_im);
+	}
+	//an odd number of passes leaves the result in scratch:
+	if (x_re != re) {
+		std::copy(x_re, x_re + size, re);
+		std::copy(x_im, x_im + size, im);
+	}
+}
+
+void FFT::inverse(float *re, float *im) {
+	//the inverse transform is the forward transform with real and imaginary parts swapped (on the way in and out):
+	forward(im, re);
+}
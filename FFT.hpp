@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+//Complex FFT of a fixed, power-of-four size, over split complex data (separate real and imaginary arrays).
+//Built from Stockham radix-4 passes (see fft_radix4_pass in mix_kernels.hpp), which reorder as they go,
+// so there is no bit-reversal step and each pass streams through memory.
+
+struct FFT {
+	FFT(uint32_t size); //throws if size isn't a power of four (4, 16, 64, ...)
+
+	//In-place transforms; unnormalized, so inverse(forward(x)) == size * x.
+	//Neither allocates (so they are fine to call from the audio thread), but they share this object's scratch space:
+	void forward(float *re, float *im);
+	void inverse(float *re, float *im);
+
+	uint32_t size;
+
+	//internals:
+	std::vector< float > twiddle_re, twiddle_im; //each pass's twiddles, in pass order (see fft_radix4_pass)
+	std::vector< float > scratch_re, scratch_im; //pass output buffers
+};
@@ -119,9 +119,20 @@ const game_names = [
 	maek.CPP('main.cpp'),
 	maek.CPP('LitColorTextureProgram.cpp'),
 	//maek.CPP('ColorTextureProgram.cpp'),  //not used right now, but you might want it
+];
+
+const sound_names = [
 	maek.CPP('Sound.cpp'),
+	maek.CPP('SoundEffects.cpp'),
+	maek.CPP('mix_kernels.cpp'),
+	maek.CPP('FFT.cpp'),
+	maek.CPP('Resampler.cpp'),
+	maek.CPP('sample_encoding.cpp'),
 	maek.CPP('load_wav.cpp'),
-	maek.CPP('load_opus.cpp')
+	maek.CPP('load_opus.cpp'),
+	maek.CPP('OpusStream.cpp'),
+	maek.CPP('pcm_cache.cpp'),
+	maek.CPP('SampleBank.cpp')
 ];
 
 const common_names = [
@@ -131,6 +142,8 @@ const common_names = [
 	maek.CPP('DrawLines.cpp'),
 	maek.CPP('ColorProgram.cpp'),
 	maek.CPP('Scene.cpp'),
+	maek.CPP('transform_kernels.cpp'),
+	maek.CPP('WorkerPool.cpp'),
 	maek.CPP('Mesh.cpp'),
 	maek.CPP('load_save_png.cpp'),
 	maek.CPP('gl_compile_program.cpp'),
@@ -151,16 +164,31 @@ const show_scene_names = [
 	maek.CPP('ShowSceneMode.cpp')
 ];
 
+const audio_bench_names = [
+	maek.CPP('audio-bench.cpp')
+];
+
+const scene_bench_names = [
+	maek.CPP('scene-bench.cpp')
+];
+
+const pack_samples_names = [
+	maek.CPP('pack-samples.cpp')
+];
+
 //the '[exeFile =] LINK(objFiles, exeFileBase, [, options])' links an array of objects into an executable:
 // objFiles: array of objects to link
 // exeFileBase: name of executable file to produce
 //returns exeFile: exeFileBase + a platform-dependant suffix (e.g., '.exe' on windows)
-const game_exe = maek.LINK([...game_names, ...common_names], 'dist/game');
+const game_exe = maek.LINK([...game_names, ...sound_names, ...common_names], 'dist/game');
 const show_meshes_exe = maek.LINK([...show_meshes_names, ...common_names], 'scenes/show-meshes');
 const show_scene_exe = maek.LINK([...show_scene_names, ...common_names], 'scenes/show-scene');
+const audio_bench_exe = maek.LINK([...audio_bench_names, ...sound_names], 'audio-bench');
+const pack_samples_exe = maek.LINK([...pack_samples_names, ...sound_names], 'pack-samples');
+const scene_bench_exe = maek.LINK([...scene_bench_names, ...common_names], 'scene-bench');
 
 //set the default target to the game (and copy the readme files):
-maek.TARGETS = [game_exe, show_meshes_exe, show_scene_exe, ...copies];
+maek.TARGETS = [game_exe, show_meshes_exe, show_scene_exe, audio_bench_exe, pack_samples_exe, scene_bench_exe, ...copies];
 
 //Note that tasks that produce ':abstract targets' are never cached.
 // This is similar to how .PHONY targets behave in make.
@@ -0,0 +1,161 @@
+#include "OpusStream.hpp"
+
+#include <opusfile.h>
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+
+//number of stereo frames to request from opusfile per read:
+// (opus packets are at most 120ms == 5760 frames long)
+constexpr uint32_t PCM_FRAMES = 5760;
+
+//amount of data start() decodes before returning, so playback can begin right away:
+// (the decoder thread leaves this much of the ring free, so there is room to prime even while an old reader still has the ring full)
+constexpr uint32_t PRIME_SIZE = 8192;
+
+//helpers for the packed 'claim' value:
+static uint32_t claim_reader(uint64_t claim) { return uint32_t(claim >> 32); }
+static uint32_t claim_begin(uint64_t claim) { return uint32_t(claim); }
+
+OpusStream::OpusStream(std::string const &filename_) : filename(filename_), op(nullptr, op_free) {
+	static_assert((RING_SIZE & (RING_SIZE - 1)) == 0, "Ring size must be a power of two.");
+
+	int err = 0;
+	op.reset(op_open_file(filename.c_str(), &err));
+	if (err != 0 || !op) {
+		throw std::runtime_error("opusfile error " + std::to_string(err) + " opening \"" + filename + "\".");
+	}
+	std::cout << "streaming '" << filename << "'." << std::endl;
+
+	ring.assign(RING_SIZE, 0.0f);
+	pcm.assign(2 * PCM_FRAMES, 0.0f);
+
+	//decoder thread tops up the ring buffer whenever the stream is in use:
+	thread = std::thread([this](){
+		while (!quit.load(std::memory_order_relaxed)) {
+			uint32_t decoded = 0;
+			if (claim_reader(claim.load(std::memory_order_acquire)) != 0) {
+				std::lock_guard< std::mutex > lock(mutex);
+				decoded = decode(RING_SIZE, PRIME_SIZE);
+			}
+			//if there was nothing to do (ring full, stream ended, or not playing) wait a bit before checking again:
+			if (decoded == 0) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(5));
+			}
+		}
+	});
+}
+
+OpusStream::~OpusStream() {
+	quit.store(true);
+	thread.join();
+}
+
+uint32_t OpusStream::decode(uint32_t max_count, uint32_t headroom) {
+	if (ended.load(std::memory_order_relaxed)) return 0;
+
+	uint32_t w = write.load(std::memory_order_relaxed);
+	uint32_t used = w - read.load(std::memory_order_acquire);
+	if (used + headroom >= RING_SIZE) return 0;
+	uint32_t space = RING_SIZE - headroom - used;
+	uint32_t want = std::min(std::min(max_count, space), PCM_FRAMES);
+	if (want == 0) return 0;
+
+	int ret = op_read_float_stereo(op.get(), pcm.data(), int(2 * want));
+	if (ret < 0) {
+		std::cerr << "opusfile read error " << ret << " streaming \"" << filename << "\"; stopping stream." << std::endl;
+		ended.store(true, std::memory_order_release);
+		return 0;
+	}
+	if (ret == 0) {
+		//end of file:
+		if (loop) {
+			int seek = op_pcm_seek(op.get(), 0);
+			if (seek != 0) {
+				std::cerr << "opusfile seek error " << seek << " looping \"" << filename << "\"; stopping stream." << std::endl;
+				ended.store(true, std::memory_order_release);
+			}
+		} else {
+			ended.store(true, std::memory_order_release);
+		}
+		return 0;
+	}
+
+	//downmix to mono (by averaging) into the ring:
+	for (uint32_t i = 0; i < uint32_t(ret); ++i) {
+		ring[(w + i) & (RING_SIZE - 1)] = (pcm[2*i] + pcm[2*i+1]) * 0.5f;
+	}
+	write.store(w + uint32_t(ret), std::memory_order_release);
+	return uint32_t(ret);
+}
+
+void OpusStream::start(bool loop_, uint32_t reader) {
+	assert(reader != 0 && "Reader 0 means 'nobody'.");
+
+	std::lock_guard< std::mutex > lock(mutex);
+
+	int seek = op_pcm_seek(op.get(), 0);
+	if (seek != 0) {
+		std::cerr << "opusfile seek error " << seek << " rewinding \"" << filename << "\"." << std::endl;
+	}
+	ended.store(false, std::memory_order_relaxed);
+	loop = loop_;
+
+	//the old reader (if any) may still be reading, so leave its data in the ring and start the new data after it:
+	// (the new reader skips ahead to 'begin' the first time it peeks)
+	uint32_t begin = write.load(std::memory_order_relaxed);
+	claim.store((uint64_t(reader) << 32) | begin, std::memory_order_release);
+
+	for (uint32_t primed = 0; primed < PRIME_SIZE; ) {
+		uint32_t decoded = decode(PRIME_SIZE - primed, 0);
+		if (decoded == 0) break;
+		primed += decoded;
+	}
+}
+
+float const *OpusStream::peek(uint32_t reader, uint32_t *count) {
+	assert(count);
+	uint64_t c = claim.load(std::memory_order_acquire);
+	if (claim_reader(c) != reader) {
+		//taken over by a newer reader:
+		*count = 0;
+		return ring.data();
+	}
+	uint32_t r = read.load(std::memory_order_relaxed);
+	if (int32_t(claim_begin(c) - r) > 0) {
+		//first peek since start(); skip whatever the previous reader left unread:
+		r = claim_begin(c);
+		read.store(r, std::memory_order_release);
+	}
+	uint32_t w = write.load(std::memory_order_acquire);
+	uint32_t at = r & (RING_SIZE - 1);
+	*count = std::min(w - r, RING_SIZE - at);
+	return ring.data() + at;
+}
+
+void OpusStream::consume(uint32_t reader, uint32_t count) {
+	if (claim_reader(claim.load(std::memory_order_acquire)) != reader) return; //taken over since peek()
+	uint32_t r = read.load(std::memory_order_relaxed);
+	assert(count <= write.load(std::memory_order_acquire) - r);
+	read.store(r + count, std::memory_order_release);
+}
+
+bool OpusStream::finished(uint32_t reader) const {
+	uint64_t c = claim.load(std::memory_order_acquire);
+	if (claim_reader(c) != reader) return true;
+	uint32_t r = read.load(std::memory_order_relaxed);
+	if (int32_t(claim_begin(c) - r) > 0) return false; //hasn't peeked yet
+	return ended.load(std::memory_order_acquire)
+	    && r == write.load(std::memory_order_acquire);
+}
+
+void OpusStream::release(uint32_t reader) {
+	//(keep the start position in case another reader already took over -- then the exchange fails and nothing changes)
+	uint64_t c = claim.load(std::memory_order_relaxed);
+	while (claim_reader(c) == reader) {
+		if (claim.compare_exchange_weak(c, uint64_t(claim_begin(c)), std::memory_order_release, std::memory_order_relaxed)) break;
+	}
+}
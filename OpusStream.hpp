@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct OggOpusFile;
+
+//OpusStream decodes an '.opus' file a little at a time on a background thread,
+// writing 48kHz mono float data into a ring buffer that the audio thread reads from.
+//This keeps long music tracks from needing to be fully decoded (and held in memory) up front.
+//
+//Only one reader at a time: a stream is claimed by start() (game thread) on behalf of a voice and
+// handed back by release() (audio thread) when playback is done. Starting a stream that is still
+// being read hands it to the new reader; the old reader sees nothing more and reports finished().
+struct OpusStream {
+	OpusStream(std::string const &filename); //throws on error
+	~OpusStream();
+
+	//--- game thread ---
+
+	//claim the stream for 'reader' (any nonzero id; Sound uses voice generations) and rewind it to the beginning,
+	// decoding a little data right away so playback can start immediately.
+	// if 'loop' is set, decoding seeks back to the start whenever it reaches the end of the file.
+	//if another reader still has the stream, it is taken over (the old reader's data is dropped once 'reader' first peeks):
+	void start(bool loop, uint32_t reader);
+
+	//--- audio thread ---
+	//(each call names the reader making it; calls from a reader that has been taken over see an empty, finished stream)
+
+	//get the longest contiguous run of decoded data that is ready to read:
+	// (returns a pointer to the data and sets *count to the number of values in the run)
+	float const *peek(uint32_t reader, uint32_t *count);
+	//mark 'count' values (at most what peek() returned) as read:
+	void consume(uint32_t reader, uint32_t count);
+	//has the whole file been read? (never true for looping streams; always true for readers that were taken over)
+	bool finished(uint32_t reader) const;
+	//done reading; the stream can be start()'ed again (does nothing if 'reader' was taken over):
+	void release(uint32_t reader);
+
+	//number of times the reader ran out of decoded data before the end of the stream:
+	std::atomic< uint32_t > underruns{0};
+
+	//--- internals ---
+	std::string filename;
+
+	//ring buffer of decoded samples;
+	// 'read' is only written by the reader, 'write' only with 'mutex' held (by the decoder or by start()):
+	static constexpr uint32_t RING_SIZE = 1 << 16; //~1.4 seconds of audio, 256KB
+	std::vector< float > ring;
+	std::atomic< uint32_t > read{0};
+	std::atomic< uint32_t > write{0};
+
+	//current reader (high 32 bits; 0 if nobody has claimed the stream) and the ring position its data starts at (low 32 bits):
+	// (a new reader moves 'read' up to its start position the first time it peeks)
+	std::atomic< uint64_t > claim{0};
+	std::atomic< bool > ended{false}; //has the decoder reached the end of a non-looping stream?
+
+	//decoder state -- only used by the decoder thread or by start(), always with 'mutex' held:
+	std::mutex mutex;
+	std::unique_ptr< OggOpusFile, void (*)(OggOpusFile *) > op;
+	bool loop = false;
+	std::vector< float > pcm; //scratch space for stereo data from opusfile
+	//decode up to max_count values into the ring, leaving at least 'headroom' values free; returns count decoded:
+	uint32_t decode(uint32_t max_count, uint32_t headroom);
+
+	std::atomic< bool > quit{false};
+	std::thread thread;
+};
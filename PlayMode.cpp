@@ -33,6 +33,9 @@ Load< Scene > main_scene(LoadTagDefault, []() -> Scene const * {
 		drawable.pipeline.type = mesh.type;
 		drawable.pipeline.start = mesh.start;
 		drawable.pipeline.count = mesh.count;
+
+		drawable.min = mesh.min;
+		drawable.max = mesh.max;
 	});
 });
 
@@ -71,8 +74,24 @@ Load< Sound::Sample > lose_sound(LoadTagDefault, []() -> Sound::Sample const * {
 		return new Sound::Sample(data_path("audio/defeat.opus"));
 });
 
+//the garden is outdoors, so its reverb is short: a few early reflections (off the walls around it) and a quick,
+// sparse decay. There's no recording of the space, so the impulse response is synthesized:
+Load< Sound::Sample > garden_response(LoadTagDefault, []() -> Sound::Sample const * {
+	std::mt19937 noise_gen(0x6a7de2);
+	std::normal_distribution< float > noise(0.0f, 1.0f);
+	std::vector< float > response(Sound::AUDIO_RATE * 3 / 4);
+	for (uint32_t i = 0; i < response.size(); ++i) {
+		float t = i / float(Sound::AUDIO_RATE);
+		response[i] = 0.02f * noise(noise_gen) * std::exp(-6.9f * t / 0.6f); //down 60dB after 0.6s
+	}
+	for (float delay : {0.011f, 0.023f, 0.037f}) {
+		response[uint32_t(delay * Sound::AUDIO_RATE)] += 0.3f;
+	}
+	return new Sound::Sample(response);
+});
+
 Load< Sound::Sample > morning_dew_bgm(LoadTagDefault, []() -> Sound::Sample const * {
-		return new Sound::Sample(data_path("audio/morning_dew.opus"));
+		return new Sound::Sample(data_path("audio/morning_dew.opus"), Sound::Sample::Streamed);
 });
 
 // set up pseudo random number generator:
@@ -101,22 +120,22 @@ PlayMode::PlayMode() :
 		}
 		// get pointer to spawn points and lose points
 		else if (transform.name == "SpawnLeft") {
-			carrot_paths[0].start_pos = transform.position;
+			carrot_paths[0].start_pos = transform.position();
 		}
 		else if (transform.name == "LoseLeft") {
-			carrot_paths[0].end_pos = transform.position;
+			carrot_paths[0].end_pos = transform.position();
 		}
 		else if (transform.name == "SpawnMiddle") {
-			carrot_paths[1].start_pos = transform.position;
+			carrot_paths[1].start_pos = transform.position();
 		}
 		else if (transform.name == "LoseMiddle") {
-			carrot_paths[1].end_pos = transform.position;
+			carrot_paths[1].end_pos = transform.position();
 		}
 		else if (transform.name == "SpawnRight") {
-			carrot_paths[2].start_pos = transform.position;
+			carrot_paths[2].start_pos = transform.position();
 		}
 		else if (transform.name == "LoseRight") {
-			carrot_paths[2].end_pos = transform.position;
+			carrot_paths[2].end_pos = transform.position();
 		}
 		else if (transform.name == "CarrotCluster0") {
 			carrot_pile_transforms[0] = &transform;
@@ -135,8 +154,8 @@ PlayMode::PlayMode() :
 			transform.enabled = false;
 		}
 		else if (transform.name == "MenuCamLocation") {
-			menu_pos = transform.position;
-			menu_quat = transform.rotation;
+			menu_pos = transform.position();
+			menu_quat = transform.rotation();
 			transform.enabled = false;
 		}
 	}
@@ -160,16 +179,16 @@ PlayMode::PlayMode() :
 	}
 
 	//cache hamster location
-	hamster_default_pos = hamster->position;
+	hamster_default_pos = hamster->position();
 	//cache carrot location
-	carrot_default_pos = idle_carrots.front().transform->position;
+	carrot_default_pos = idle_carrots.front().transform->position();
 
 	{//precompute hamster rotations
 		hamster_rotations[0] = glm::angleAxis(
 			glm::radians(-45.0f),
 			glm::vec3(0.0f, 0.0f, 1.0f)
 		);
-		hamster_rotations[1] = hamster->rotation;
+		hamster_rotations[1] = hamster->rotation();
 		hamster_rotations[2] = glm::angleAxis(
 			glm::radians(45.0f),
 			glm::vec3(0.0f, 0.0f, 1.0f)
@@ -179,15 +198,18 @@ PlayMode::PlayMode() :
 	//get pointer to camera for convenience:
 	if (scene.cameras.size() != 1) throw std::runtime_error("Expecting scene to have exactly one camera, but it has " + std::to_string(scene.cameras.size()));
 	camera = &scene.cameras.front();
-	in_game_pos = camera->transform->position;
-	in_game_quat = camera->transform->rotation;
-	camera->transform->position = menu_pos;
-	camera->transform->rotation = menu_quat;
+	in_game_pos = camera->transform->position();
+	in_game_quat = camera->transform->rotation();
+	camera->transform->set_position(menu_pos);
+	camera->transform->set_rotation(menu_quat);
+
+	//build world matrices for the whole scene in one batched pass (instead of one transform at a time):
+	scene.pack_transforms();
 
 	// set sound locations
 	for (uint8_t i = 0; i < carrot_paths.size(); ++i) {
 		sound_locations[i] = carrot_paths[i].end_pos;
-		sound_locations[i].z = camera->transform->position.z;
+		sound_locations[i].z = camera->transform->position().z;
 	}
 
 	{ //update listener to camera position:
@@ -198,10 +220,17 @@ PlayMode::PlayMode() :
 		Sound::listener.set_position_right(frame_at, frame_right, 1.0f / 60.0f);
 	}
 
-	Sound::loop(*morning_dew_bgm,0.1f);
+	//sound effects get the garden's reverb (via the Aux bus):
+	garden_reverb = std::make_unique< Sound::ConvolutionReverb >(*garden_response);
+	Sound::add_bus_effect(Sound::Aux, garden_reverb.get());
+	Sound::set_bus_send(Sound::SFX, Sound::Aux, 0.25f);
+
+	Sound::loop(*morning_dew_bgm, 0.1f, 0.0f, 0, Sound::Music);
 }
 
 PlayMode::~PlayMode() {
+	Sound::set_bus_send(Sound::SFX, Sound::Aux, 0.0f);
+	Sound::remove_bus_effect(Sound::Aux, garden_reverb.get());
 }
 
 bool PlayMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size) {
@@ -255,8 +284,8 @@ void PlayMode::update(float elapsed) {
 	
 	if (menu && start.pressed) {
 		menu = false;
-		camera->transform->position = in_game_pos;
-		camera->transform->rotation = in_game_quat;
+		camera->transform->set_position(in_game_pos);
+		camera->transform->set_rotation(in_game_quat);
 		for (uint8_t i = 0; i < carrot_pile_transforms.size(); ++i) {
 			carrot_pile_transforms[i]->enabled = false;
 		}
@@ -282,11 +311,11 @@ void PlayMode::update(float elapsed) {
 		score = 0;
 		health = 3;
 
-		hamster->position = hamster_default_pos;
-		hamster->rotation = hamster_rotations[1];
+		hamster->set_position(hamster_default_pos);
+		hamster->set_rotation(hamster_rotations[1]);
 
 		for (auto carrot_it = in_action_carrots.begin(); carrot_it != in_action_carrots.end(); ) {
-			carrot_it->transform->position = carrot_default_pos;
+			carrot_it->transform->set_position(carrot_default_pos);
 			idle_carrots.push_back(*carrot_it);
 			carrot_it = in_action_carrots.erase(carrot_it);
 			continue;
@@ -304,13 +333,13 @@ void PlayMode::update(float elapsed) {
 			since_caught += elapsed;
 			if (since_caught > max_caught_time) {
 				since_caught = 0.0f;
-				caught_carrot->transform->position = carrot_default_pos;
+				caught_carrot->transform->set_position(carrot_default_pos);
 				idle_carrots.push_back(*caught_carrot);
 				in_action_carrots.erase(caught_carrot);
 			}
 			else { // carrot arrest animation
-				caught_carrot->transform->scale = glm::vec3((.5f - since_caught) * 2.0f);
-				caught_carrot->transform->position.z += elapsed * 10.0f;
+				caught_carrot->transform->set_scale(glm::vec3((.5f - since_caught) * 2.0f));
+				caught_carrot->transform->set_position(caught_carrot->transform->position() + glm::vec3(0.0f, 0.0f, elapsed * 10.0f));
 			}
 		}
 	}
@@ -323,15 +352,15 @@ void PlayMode::update(float elapsed) {
 				if (carrot_it->on_screen && carrot_it->path_index == hamster_path_index && !carrot_it->caught) {
 					if (since_caught != 0.0f) { // get rid of the previous caught carrot
 						since_caught = 0.0f;
-						caught_carrot->transform->position = carrot_default_pos;
+						caught_carrot->transform->set_position(carrot_default_pos);
 						idle_carrots.push_back(*caught_carrot);
 						in_action_carrots.erase(caught_carrot);
 					}
 
 					caught_carrot = carrot_it;
 					carrot_it->caught = true;
-					hamster->position = carrot_paths[carrot_it->path_index].start_pos + (carrot_paths[carrot_it->path_index].end_pos - carrot_paths[carrot_it->path_index].start_pos) * (carrot_it->t + .1f);
-					hamster->rotation = hamster_rotations[hamster_path_index];
+					hamster->set_position(carrot_paths[carrot_it->path_index].start_pos + (carrot_paths[carrot_it->path_index].end_pos - carrot_paths[carrot_it->path_index].start_pos) * (carrot_it->t + .1f));
+					hamster->set_rotation(hamster_rotations[hamster_path_index]);
 					since_caught = 0.01f;
 					score++;
 					
@@ -346,19 +375,19 @@ void PlayMode::update(float elapsed) {
 							carrot_pile_transforms[0]->enabled = true;
 						} 
 					}
-					Sound::play_3D(*caught_carrot_sound, 1.0f, carrot_it->transform->position, 200.0f);
+					Sound::play_3D(*caught_carrot_sound, 1.0f, carrot_it->transform->position(), 200.0f);
 					break;
 				}
 			}
 			if (since_caught == 0.0f) { //did not have anything to catch
-				hamster->position = carrot_paths[hamster_path_index].end_pos;
-				hamster->rotation = hamster_rotations[hamster_path_index];
+				hamster->set_position(carrot_paths[hamster_path_index].end_pos);
+				hamster->set_rotation(hamster_rotations[hamster_path_index]);
 			}
 
 		}
 		else if (since_caught == 0.0f) {
-			hamster->position = hamster_default_pos;
-			hamster->rotation = hamster_rotations[1];
+			hamster->set_position(hamster_default_pos);
+			hamster->set_rotation(hamster_rotations[1]);
 		}
 		
 	}
@@ -375,10 +404,10 @@ void PlayMode::update(float elapsed) {
 			// player loses health
 			health--;
 			if (health > 0)
-				Sound::play_3D(*take_damage_sound, 1.0f, carrot_it->transform->position, 200.0f);
+				Sound::play_3D(*take_damage_sound, 1.0f, carrot_it->transform->position(), 200.0f);
 			else
 				Sound::play(*lose_sound, 1.0f);
-			carrot_it->transform->position = carrot_default_pos;
+			carrot_it->transform->set_position(carrot_default_pos);
 			idle_carrots.push_back(*carrot_it);
 			carrot_it = in_action_carrots.erase(carrot_it);
 			continue;
@@ -392,12 +421,11 @@ void PlayMode::update(float elapsed) {
 				Sound::play_3D(*(spawn_sounds[carrot_it->path_index]), audio_level, sound_locations[carrot_it->path_index], 2000.0f);
 		}
 		// move along path
-		carrot_it->transform->position = carrot_paths[carrot_it->path_index].start_pos + (carrot_paths[carrot_it->path_index].end_pos - carrot_paths[carrot_it->path_index].start_pos) * carrot_it->t;
+		carrot_it->transform->set_position(carrot_paths[carrot_it->path_index].start_pos + (carrot_paths[carrot_it->path_index].end_pos - carrot_paths[carrot_it->path_index].start_pos) * carrot_it->t);
 		// movement animation
-		carrot_it->transform->scale.z = std::sin(carrot_it->t*20.0f)*0.25f + 1.0f;
+		float z_scale = std::sin(carrot_it->t*20.0f)*0.25f + 1.0f;
 		float xy_scale = std::sin(carrot_it->t*20.0f)*-0.25f + 1.0f;
-		carrot_it->transform->scale.x = xy_scale;
-		carrot_it->transform->scale.x = xy_scale;
+		carrot_it->transform->set_scale(glm::vec3(xy_scale, carrot_it->transform->scale().y, z_scale));
 		carrot_it++;
     }
 	if (!tutorial) // ramp up spawn speed
@@ -421,7 +449,7 @@ void PlayMode::update(float elapsed) {
 			new_carrot.on_screen = false;
 			new_carrot.caught = false;
 			new_carrot.t = 0.0f;
-			new_carrot.transform->scale = glm::vec3(1.0f);
+			new_carrot.transform->set_scale(glm::vec3(1.0f));
 			in_action_carrots.push_back(new_carrot);
 		}
 	};
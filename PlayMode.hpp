@@ -2,12 +2,14 @@
 
 #include "Scene.hpp"
 #include "Sound.hpp"
+#include "SoundEffects.hpp"
 
 #include <glm/glm.hpp>
 
 #include <deque>
 #include <list>
 #include <array>
+#include <memory>
 
 struct PlayMode : Mode {
 	PlayMode();
@@ -66,6 +68,9 @@ struct PlayMode : Mode {
 
 	//sound locations
 	std::array<glm::vec3, 3> sound_locations;
+
+	//reverb for sound effects (on the Aux bus):
+	std::unique_ptr< Sound::ConvolutionReverb > garden_reverb;
 	
 	//camera:
 	Scene::Camera *camera = nullptr;
@@ -0,0 +1,111 @@
+#include "Resampler.hpp"
+#include "mix_kernels.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+
+//filter design: zero crossings of the sinc on each side of the center, Kaiser window shape, and passband (fraction of Nyquist):
+static constexpr double const ZERO_CROSSINGS = 16.0;
+static constexpr double const KAISER_BETA = 8.0;
+static constexpr double const PASSBAND = 0.95;
+//largest phase table (more phases than this get rounded to the nearest 1/MAX_PHASES of an input sample):
+static constexpr uint32_t const MAX_PHASES = 1024;
+
+static constexpr double const PI = 3.14159265358979323846;
+
+//zeroth-order modified Bessel function of the first kind (for the Kaiser window), by its power series:
+static double bessel_i0(double x) {
+	double sum = 1.0;
+	double term = 1.0;
+	for (uint32_t k = 1; k < 50; ++k) {
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+		if (term < sum * 1e-12) break;
+	}
+	return sum;
+}
+
+Resampler::Resampler(uint32_t from_rate_, uint32_t to_rate_) : from_rate(from_rate_), to_rate(to_rate_) {
+	if (from_rate == 0 || to_rate == 0) {
+		throw std::runtime_error("Can't resample from " + std::to_string(from_rate) + " Hz to " + std::to_string(to_rate) + " Hz.");
+	}
+	uint32_t gcd = std::gcd(from_rate, to_rate);
+	up = to_rate / gcd;
+	down = from_rate / gcd;
+	phases = std::min(up, MAX_PHASES);
+
+	//low-pass cutoff, in cycles per input sample (below the lower of the two Nyquist frequencies):
+	double cutoff = 0.5 * PASSBAND * std::min(1.0, double(to_rate) / double(from_rate));
+	uint32_t half = uint32_t(std::ceil(ZERO_CROSSINGS / (2.0 * cutoff)));
+	taps = (2 * half + 7) / 8 * 8;
+
+	//window covers input samples base - (taps/2 - 1) .. base + taps/2 for an output at input time base + frac:
+	filter.resize(size_t(phases) * taps);
+	double const radius = taps / 2.0;
+	for (uint32_t p = 0; p < phases; ++p) {
+		double frac = double(p) / double(phases);
+		float *coefficients = filter.data() + size_t(p) * taps;
+		double sum = 0.0;
+		for (uint32_t k = 0; k < taps; ++k) {
+			double t = frac + (radius - 1.0) - double(k); //distance from the input sample to the output time
+			double value = 0.0;
+			if (std::abs(t) < radius) {
+				double x = 2.0 * cutoff * t;
+				double sinc = (x == 0.0 ? 1.0 : std::sin(PI * x) / (PI * x));
+				double r = t / radius;
+				value = 2.0 * cutoff * sinc * bessel_i0(KAISER_BETA * std::sqrt(1.0 - r * r)) / bessel_i0(KAISER_BETA);
+			}
+			coefficients[k] = float(value);
+			sum += value;
+		}
+		//normalize each phase to unity gain at DC (otherwise slightly different phase gains would add a buzz at the phase rate):
+		for (uint32_t k = 0; k < taps; ++k) {
+			coefficients[k] = float(coefficients[k] / sum);
+		}
+	}
+
+	//start with silence before the first input sample:
+	buffer.assign(taps - 1 + MAX_INPUT, 0.0f);
+	buffered = taps / 2 - 1;
+}
+
+uint32_t Resampler::max_output(uint32_t count) const {
+	return uint32_t((uint64_t(count) * up + down - 1) / down) + 1;
+}
+
+uint32_t Resampler::process(float const *in, uint32_t count, float *out) {
+	assert(count <= MAX_INPUT);
+	assert(buffered + count <= buffer.size());
+	std::copy(in, in + count, buffer.begin() + buffered);
+	buffered += count;
+	return produce(out);
+}
+
+uint32_t Resampler::flush(float *out) {
+	//(the last input sample needs taps/2 more samples after it before the outputs around it are ready)
+	std::fill(buffer.begin() + buffered, buffer.begin() + buffered + taps / 2, 0.0f);
+	buffered += taps / 2;
+	return produce(out);
+}
+
+uint32_t Resampler::produce(float *out) {
+	uint32_t written = 0;
+	while (start + taps <= buffered) {
+		uint32_t phase = (phases == up ? remainder : uint32_t(uint64_t(remainder) * phases / up));
+		out[written++] = dot_product(buffer.data() + start, filter.data() + size_t(phase) * taps, taps);
+		remainder += down;
+		start += remainder / up;
+		remainder %= up;
+	}
+
+	//drop input that no output will need again:
+	uint32_t used = uint32_t(std::min< uint64_t >(start, buffered));
+	std::copy(buffer.begin() + used, buffer.begin() + buffered, buffer.begin());
+	buffered -= used;
+	start -= used;
+
+	return written;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+//Streaming sample rate converter for mono float audio, using a windowed-sinc (Kaiser) polyphase filter.
+//
+//Output sample n lands at input time n * from_rate / to_rate (so the output lines up with the input; there's
+// no extra delay in the output's timeline), but each output can only be computed once the input has reached
+// HALF the filter length past it -- call flush() at the end of a stream to get the last few outputs.
+//Downsampling lowers the filter's cutoff below the new Nyquist frequency, so it doesn't alias.
+
+struct Resampler {
+	Resampler(uint32_t from_rate, uint32_t to_rate); //throws if either rate is zero
+
+	//most input samples per process() call:
+	static constexpr uint32_t const MAX_INPUT = 4096;
+
+	//Take in 'count' (at most MAX_INPUT) input samples, write as many outputs as are ready to 'out', and return how many that was.
+	//Never more than max_output(count); doesn't allocate (so it is fine to call from the audio thread):
+	uint32_t process(float const *in, uint32_t count, float *out);
+	uint32_t max_output(uint32_t count) const;
+
+	//Pretend the input continues with silence long enough to compute every output up to the current input position:
+	uint32_t flush(float *out); //writes at most max_output(taps) outputs; also doesn't allocate
+
+	uint32_t from_rate, to_rate;
+
+	//internals:
+	uint32_t up = 1, down = 1; //to_rate / from_rate in lowest terms (output n is at input time n * down / up)
+	uint32_t phases = 1; //filter phases (== up, unless that would be a huge table; then fractional times are rounded down to 1 / phases)
+	uint32_t taps = 0; //filter length, in input samples (a multiple of 8)
+	std::vector< float > filter; //'taps' coefficients per phase, for phase p (input time base + p / phases) at [p * taps]
+	std::vector< float > buffer; //input not yet used up: the filter window for the next output starts at buffer[start]
+	uint32_t buffered = 0; //samples in buffer
+	uint64_t start = 0; //(may be past 'buffered' when downsampling skips over input that hasn't arrived yet)
+	uint32_t remainder = 0; //fractional input time of next output, in units of 1 / up
+	uint32_t produce(float *out); //compute every output the buffered input allows
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <utility>
+
+//Fixed-capacity, lock-free, single-producer/single-consumer queue.
+// push() must only ever be called from one thread and pop() from one (other) thread.
+// Neither call blocks or allocates, so this is safe to use from inside the audio callback.
+template< typename T, uint32_t Capacity >
+struct SPSCQueue {
+	static_assert(Capacity != 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two.");
+
+	//add a value to the back of the queue; returns false (and leaves 'value' alone) if the queue is full:
+	bool push(T &&value) {
+		uint32_t t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) == Capacity) return false;
+		slots[t & (Capacity - 1)] = std::move(value);
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+	bool push(T const &value) {
+		T copy = value;
+		return push(std::move(copy));
+	}
+
+	//remove a value from the front of the queue; returns false if the queue is empty:
+	bool pop(T *value) {
+		uint32_t h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire)) return false;
+		*value = std::move(slots[h & (Capacity - 1)]);
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	//number of values in the queue (only approximate if called while the other thread is active):
+	uint32_t size() const {
+		return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+	}
+
+	//internals:
+	std::array< T, Capacity > slots;
+	std::atomic< uint32_t > head{0}; //index of next slot to pop (written only by consumer)
+	std::atomic< uint32_t > tail{0}; //index of next slot to push (written only by producer)
+};
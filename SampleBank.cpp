@@ -0,0 +1,203 @@
+#include "SampleBank.hpp"
+#include "read_write_chunk.hpp"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+//Bank files are a sequence of chunks in the read_write_chunk.hpp format:
+// |idx0|..| IndexEntry * N -- name and data ranges for each sample
+// |f32m|..| float * M      -- all sample data (starts 16-byte aligned in the file)
+// |str0|..| char * L       -- all sample names
+struct IndexEntry {
+	uint32_t name_begin, name_end; //range in str0
+	uint32_t data_begin, data_end; //range in f32m
+};
+static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
+
+struct ChunkHeader {
+	char magic[4];
+	uint32_t size;
+};
+static_assert(sizeof(ChunkHeader) == 8, "header is packed");
+
+static void unmap(SampleBank *bank) {
+	#if defined(_WIN32)
+	UnmapViewOfFile(bank->mapping);
+	CloseHandle(bank->mapping_handle);
+	CloseHandle(bank->file_handle);
+	#else
+	munmap(const_cast< void * >(bank->mapping), bank->mapping_size);
+	#endif
+	bank->mapping = nullptr;
+	bank->mapping_size = 0;
+}
+
+SampleBank::SampleBank(std::string const &filename) {
+	//--- map the file ---
+	#if defined(_WIN32)
+	file_handle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file_handle == INVALID_HANDLE_VALUE) {
+		file_handle = nullptr;
+		throw std::runtime_error("Failed to open sample bank '" + filename + "'.");
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file_handle, &size) || size.QuadPart == 0) {
+		CloseHandle(file_handle);
+		throw std::runtime_error("Failed to get size of sample bank '" + filename + "' (or it is empty).");
+	}
+	mapping_size = size_t(size.QuadPart);
+	mapping_handle = CreateFileMappingA(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping_handle) {
+		mapping = MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+	}
+	if (!mapping) {
+		if (mapping_handle) CloseHandle(mapping_handle);
+		CloseHandle(file_handle);
+		throw std::runtime_error("Failed to map sample bank '" + filename + "'.");
+	}
+	#else
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		throw std::runtime_error("Failed to open sample bank '" + filename + "'.");
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		throw std::runtime_error("Failed to get size of sample bank '" + filename + "' (or it is empty).");
+	}
+	mapping_size = size_t(st.st_size);
+	void *mapped = mmap(nullptr, mapping_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd); //(mapping stays valid after the descriptor is closed)
+	if (mapped == MAP_FAILED) {
+		throw std::runtime_error("Failed to map sample bank '" + filename + "'.");
+	}
+	mapping = mapped;
+	#endif
+
+	//(the destructor won't run if the constructor throws, so clean up by hand:)
+	try {
+		parse(filename);
+	} catch (...) {
+		samples.clear();
+		unmap(this);
+		throw;
+	}
+}
+
+void SampleBank::parse(std::string const &filename) {
+	//--- find the chunks (without touching the sample data) ---
+	char const *bytes = reinterpret_cast< char const * >(mapping);
+	size_t at = 0;
+	auto next_chunk = [&](char const *magic, uint32_t element_size, size_t *count) -> char const * {
+		ChunkHeader header;
+		if (mapping_size - at < sizeof(header)) {
+			throw std::runtime_error("Sample bank '" + filename + "' ends before '" + std::string(magic, 4) + "' chunk.");
+		}
+		std::memcpy(&header, bytes + at, sizeof(header));
+		at += sizeof(header);
+		if (std::memcmp(header.magic, magic, 4) != 0) {
+			throw std::runtime_error("Sample bank '" + filename + "' has unexpected magic number in place of '" + std::string(magic, 4) + "' chunk.");
+		}
+		if (header.size % element_size != 0 || mapping_size - at < header.size) {
+			throw std::runtime_error("Sample bank '" + filename + "' has bad size for '" + std::string(magic, 4) + "' chunk.");
+		}
+		char const *data = bytes + at;
+		at += header.size;
+		*count = header.size / element_size;
+		return data;
+	};
+
+	size_t index_count = 0, data_count = 0, strings_count = 0;
+	char const *index_bytes = next_chunk("idx0", sizeof(IndexEntry), &index_count);
+	char const *data_bytes = next_chunk("f32m", sizeof(float), &data_count);
+	char const *strings = next_chunk("str0", sizeof(char), &strings_count);
+
+	if (at != mapping_size) {
+		std::cerr << "WARNING: trailing data in sample bank '" << filename << "'" << std::endl;
+	}
+	if (reinterpret_cast< uintptr_t >(data_bytes) % alignof(float) != 0) {
+		throw std::runtime_error("Sample bank '" + filename + "' has misaligned sample data.");
+	}
+	float const *data = reinterpret_cast< float const * >(data_bytes);
+
+	for (size_t i = 0; i < index_count; ++i) {
+		IndexEntry entry;
+		std::memcpy(&entry, index_bytes + i * sizeof(IndexEntry), sizeof(IndexEntry));
+		if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings_count)) {
+			throw std::runtime_error("index entry has out-of-range name begin/end");
+		}
+		if (!(entry.data_begin <= entry.data_end && entry.data_end <= data_count)) {
+			throw std::runtime_error("index entry has out-of-range data begin/end");
+		}
+		std::string name(strings + entry.name_begin, strings + entry.name_end);
+		bool inserted = samples.emplace(std::piecewise_construct,
+			std::forward_as_tuple(name),
+			std::forward_as_tuple(data + entry.data_begin, entry.data_end - entry.data_begin)
+		).second;
+		if (!inserted) {
+			std::cerr << "WARNING: sample name '" + name + "' in sample bank '" + filename + "' collides with existing sample." << std::endl;
+		}
+	}
+}
+
+SampleBank::~SampleBank() {
+	samples.clear();
+	unmap(this);
+}
+
+Sound::Sample const &SampleBank::lookup(std::string const &name) const {
+	auto f = samples.find(name);
+	if (f == samples.end()) {
+		throw std::runtime_error("Looking up sample '" + name + "' that doesn't exist.");
+	}
+	return f->second;
+}
+
+void SampleBank::write(std::string const &filename, std::vector< std::pair< std::string, Sound::Sample const * > > const &samples_) {
+	std::vector< IndexEntry > index;
+	std::vector< float > data;
+	std::vector< char > strings;
+
+	for (auto const &[name, sample] : samples_) {
+		assert(sample);
+		if (sample->stream) {
+			throw std::runtime_error("Can't store streamed sample '" + name + "' in a sample bank.");
+		}
+		if (sample->managed) {
+			throw std::runtime_error("Can't store budgeted sample '" + name + "' in a sample bank (load it with no sample memory budget set).");
+		}
+		if (sample->storage != Sound::Sample::Decoded) {
+			throw std::runtime_error("Can't store Int16 / ADPCM sample '" + name + "' in a sample bank (banks hold float data).");
+		}
+		IndexEntry entry;
+		entry.name_begin = uint32_t(strings.size());
+		strings.insert(strings.end(), name.begin(), name.end());
+		entry.name_end = uint32_t(strings.size());
+
+		entry.data_begin = uint32_t(data.size());
+		data.insert(data.end(), sample->samples(), sample->samples() + sample->sample_count());
+		entry.data_end = uint32_t(data.size());
+
+		index.emplace_back(entry);
+	}
+
+	std::ofstream file(filename, std::ios::binary);
+	write_chunk("idx0", index, &file);
+	write_chunk("f32m", data, &file);
+	write_chunk("str0", strings, &file);
+	if (!file) {
+		throw std::runtime_error("Failed to write sample bank '" + filename + "'.");
+	}
+}
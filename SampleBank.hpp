@@ -0,0 +1,56 @@
+#pragma once
+
+/*
+ * A "SampleBank" is a single file holding many pre-decoded (48kHz, mono, float) samples.
+ *
+ * The bank file is memory-mapped and the Sound::Sample objects it provides are views
+ *  into the mapping -- no sample data is copied when loading, pages are only read as
+ *  they are played, and the (read-only) pages can be shared by every process on the
+ *  machine that has the same bank open.
+ *
+ * Bank files are written by SampleBank::write (see the 'pack-samples' tool).
+ *
+ */
+
+#include "Sound.hpp"
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct SampleBank {
+	//map a bank file:
+	// note: will throw if file fails to load.
+	SampleBank(std::string const &filename);
+	~SampleBank();
+
+	//samples refer into the mapping, so banks can't be copied:
+	SampleBank(SampleBank const &) = delete;
+	SampleBank &operator=(SampleBank const &) = delete;
+
+	//look up a particular sample by name:
+	// note: will throw if sample not found.
+	// (samples are only valid as long as the bank is)
+	Sound::Sample const &lookup(std::string const &name) const;
+
+	//write a bank file holding the given (name, sample) pairs:
+	// note: will throw if file fails to write; streamed, Int16, and ADPCM samples can't be stored.
+	static void write(std::string const &filename, std::vector< std::pair< std::string, Sound::Sample const * > > const &samples);
+
+	//-- internals ---
+
+	//used by the lookup() function:
+	std::map< std::string, Sound::Sample > samples;
+
+	//build 'samples' from the mapped file (called by the constructor):
+	void parse(std::string const &filename);
+
+	//the mapped file:
+	void const *mapping = nullptr;
+	size_t mapping_size = 0;
+	#ifdef _WIN32
+	void *file_handle = nullptr; //HANDLE of the file
+	void *mapping_handle = nullptr; //HANDLE of the file mapping
+	#endif
+};
@@ -2,13 +2,71 @@
 
 #include "gl_errors.hpp"
 #include "read_write_chunk.hpp"
+#include "transform_kernels.hpp"
+#include "WorkerPool.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
 #include <fstream>
 
 //-------------------------
 
+Scene::Transform::~Transform() {
+	if (arrays) {
+		arrays->transforms[array_index] = nullptr;
+		arrays->order_dirty = true;
+	}
+	set_parent(nullptr);
+	for (Transform *child : children) {
+		child->parent_ = nullptr;
+		if (child->arrays) child->arrays->order_dirty = true;
+		child->mark_dirty();
+	}
+}
+
+void Scene::Transform::set_position(glm::vec3 const &position) {
+	position_ = position;
+	if (arrays) arrays->store(*this);
+	mark_dirty();
+}
+
+void Scene::Transform::set_rotation(glm::quat const &rotation) {
+	rotation_ = rotation;
+	if (arrays) arrays->store(*this);
+	mark_dirty();
+}
+
+void Scene::Transform::set_scale(glm::vec3 const &scale) {
+	scale_ = scale;
+	if (arrays) arrays->store(*this);
+	mark_dirty();
+}
+
+void Scene::Transform::set_parent(Transform *parent) {
+	if (parent == parent_) return;
+	if (arrays) arrays->order_dirty = true;
+	if (parent_) {
+		auto f = std::find(parent_->children.begin(), parent_->children.end(), this);
+		assert(f != parent_->children.end());
+		parent_->children.erase(f);
+	}
+	parent_ = parent;
+	if (parent_) {
+		parent_->children.emplace_back(this);
+	}
+	mark_dirty();
+}
+
+void Scene::Transform::mark_dirty() {
+	if (local_to_world_dirty && world_to_local_dirty) return; //(descendants are already dirty as well)
+	local_to_world_dirty = true;
+	world_to_local_dirty = true;
+	for (Transform *child : children) {
+		child->mark_dirty();
+	}
+}
+
 glm::mat4x3 Scene::Transform::make_local_to_parent() const {
 	//compute:
 	//   translate   *   rotate    *   scale
@@ -17,12 +75,12 @@ glm::mat4x3 Scene::Transform::make_local_to_parent() const {
 	// [ 0 0 1 p.z ]   [       0 ]   [ 0 0 s.z 0 ]
 	//                 [ 0 0 0 1 ]   [ 0 0   0 1 ]
 
-	glm::mat3 rot = glm::mat3_cast(rotation);
+	glm::mat3 rot = glm::mat3_cast(rotation_);
 	return glm::mat4x3(
-		rot[0] * scale.x, //scaling the columns here means that scale happens before rotation
-		rot[1] * scale.y,
-		rot[2] * scale.z,
-		position
+		rot[0] * scale_.x, //scaling the columns here means that scale happens before rotation
+		rot[1] * scale_.y,
+		rot[2] * scale_.z,
+		position_
 	);
 }
 
@@ -36,12 +94,12 @@ glm::mat4x3 Scene::Transform::make_parent_to_local() const {
 
 	glm::vec3 inv_scale;
 	//taking some care so that we don't end up with NaN's , just a degenerate matrix, if scale is zero:
-	inv_scale.x = (scale.x == 0.0f ? 0.0f : 1.0f / scale.x);
-	inv_scale.y = (scale.y == 0.0f ? 0.0f : 1.0f / scale.y);
-	inv_scale.z = (scale.z == 0.0f ? 0.0f : 1.0f / scale.z);
+	inv_scale.x = (scale_.x == 0.0f ? 0.0f : 1.0f / scale_.x);
+	inv_scale.y = (scale_.y == 0.0f ? 0.0f : 1.0f / scale_.y);
+	inv_scale.z = (scale_.z == 0.0f ? 0.0f : 1.0f / scale_.z);
 
 	//compute inverse of rotation:
-	glm::mat3 inv_rot = glm::mat3_cast(glm::inverse(rotation));
+	glm::mat3 inv_rot = glm::mat3_cast(glm::inverse(rotation_));
 
 	//scale the rows of rot:
 	inv_rot[0] *= inv_scale;
@@ -52,23 +110,187 @@ glm::mat4x3 Scene::Transform::make_parent_to_local() const {
 		inv_rot[0],
 		inv_rot[1],
 		inv_rot[2],
-		inv_rot * -position
+		inv_rot * -position_
 	);
 }
 
 glm::mat4x3 Scene::Transform::make_local_to_world() const {
-	if (!parent) {
-		return make_local_to_parent();
-	} else {
-		return parent->make_local_to_world() * glm::mat4(make_local_to_parent()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+	if (arrays) {
+		arrays->update();
+		//(descendants that aren't packed may cache against this matrix, so changes still need to reach them:
+		// clear the flags of this transform and its ancestors -- all packed, after update() -- to keep dirty descendants dirty)
+		for (Transform const *t = this; t && t->local_to_world_dirty; t = t->parent_) {
+			assert(t->arrays == arrays);
+			t->local_to_world_dirty = false;
+		}
+		return arrays->local_to_world[array_index];
 	}
+	if (local_to_world_dirty) {
+		if (!parent_) {
+			local_to_world = make_local_to_parent();
+		} else {
+			local_to_world = parent_->make_local_to_world() * glm::mat4(make_local_to_parent()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+		}
+		local_to_world_dirty = false;
+	}
+	return local_to_world;
 }
 glm::mat4x3 Scene::Transform::make_world_to_local() const {
-	if (!parent) {
-		return make_parent_to_local();
-	} else {
-		return make_parent_to_local() * glm::mat4(parent->make_world_to_local()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+	if (world_to_local_dirty) {
+		if (!parent_) {
+			world_to_local = make_parent_to_local();
+		} else {
+			world_to_local = make_parent_to_local() * glm::mat4(parent_->make_world_to_local()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+		}
+		world_to_local_dirty = false;
+	}
+	return world_to_local;
+}
+
+//-------------------------
+
+static_assert(sizeof(glm::mat4x3) == 12 * sizeof(float), "mat4x3 is packed, as transform_kernels expects.");
+
+Scene::TransformArrays::TransformArrays(std::vector< Transform * > const &from) {
+	pack(from);
+}
+
+Scene::TransformArrays::~TransformArrays() {
+	update();
+	//leave each transform with its current matrix cached:
+	for (uint32_t i = 0; i < transforms.size(); ++i) {
+		Transform *t = transforms[i];
+		if (!t) continue;
+		t->arrays = nullptr;
+		t->local_to_world = local_to_world[i];
+		t->local_to_world_dirty = false;
+	}
+}
+
+void Scene::TransformArrays::pack(std::vector< Transform * > const &from) {
+	//mark transforms to pack, and their ancestors, noting roots as they are found:
+	std::vector< Transform * > roots;
+	for (Transform *t : from) {
+		for (Transform *a = t; a && a->arrays != this; a = a->parent_) {
+			a->arrays = this;
+			if (!a->parent_) roots.emplace_back(a);
+		}
+	}
+
+	//order breadth-first from the roots, so transforms are sorted by depth (and parents always come before their children):
+	transforms = roots;
+	levels.clear();
+	uint32_t level_end = 0;
+	for (uint32_t i = 0; i < transforms.size(); ++i) {
+		if (i == level_end) {
+			//all of the previous level's children have been added, so they make up the next level:
+			levels.emplace_back(i);
+			level_end = uint32_t(transforms.size());
+		}
+		Transform *t = transforms[i];
+		for (Transform *child : t->children) {
+			if (child->arrays == this) transforms.emplace_back(child);
+		}
+	}
+
+	uint32_t count = uint32_t(transforms.size());
+	for (auto &v : position) v.resize(count);
+	for (auto &v : rotation) v.resize(count);
+	for (auto &v : scale) v.resize(count);
+	parent.resize(count);
+	local_to_world.resize(count);
+
+	for (uint32_t i = 0; i < count; ++i) {
+		Transform *t = transforms[i];
+		t->array_index = i;
+		store(*t);
+		parent[i] = (t->parent_ ? t->parent_->array_index : -1U);
+		assert(parent[i] == -1U || parent[i] < i);
+	}
+
+	dirty_begin = 0;
+	order_dirty = false;
+}
+
+void Scene::TransformArrays::store(Transform const &t) {
+	uint32_t i = t.array_index;
+	position[0][i] = t.position_.x;
+	position[1][i] = t.position_.y;
+	position[2][i] = t.position_.z;
+	rotation[0][i] = t.rotation_.x;
+	rotation[1][i] = t.rotation_.y;
+	rotation[2][i] = t.rotation_.z;
+	rotation[3][i] = t.rotation_.w;
+	scale[0][i] = t.scale_.x;
+	scale[1][i] = t.scale_.y;
+	scale[2][i] = t.scale_.z;
+	dirty_begin = std::min(dirty_begin, i);
+}
+
+void Scene::TransformArrays::update(WorkerPool *pool) {
+	if (order_dirty) {
+		//re-pack the surviving transforms:
+		std::vector< Transform * > from;
+		from.reserve(transforms.size());
+		for (Transform *t : transforms) {
+			if (!t) continue;
+			t->arrays = nullptr;
+			from.emplace_back(t);
+		}
+		pack(from);
+	}
+
+	uint32_t count = uint32_t(transforms.size());
+	if (dirty_begin < count) {
+		TransformSoA soa;
+		for (uint32_t c = 0; c < 3; ++c) soa.position[c] = position[c].data();
+		for (uint32_t c = 0; c < 4; ++c) soa.rotation[c] = rotation[c].data();
+		for (uint32_t c = 0; c < 3; ++c) soa.scale[c] = scale[c].data();
+		soa.parent = parent.data();
+		float *out = reinterpret_cast< float * >(local_to_world.data());
+		if (!pool || pool->get_thread_count() == 1 || count - dirty_begin < MIN_PARALLEL_LEVEL) {
+			build_local_to_world(soa, dirty_begin, count, out);
+		} else {
+			//every parent is in an earlier level, so the transforms within a level can be built in any order;
+			// each level is split into chunks (multiples of eight transforms, to keep vector blocks whole) for the pool's threads:
+			uint32_t max_chunks = 4 * pool->get_thread_count();
+			for (uint32_t l = 0; l < levels.size(); ++l) {
+				uint32_t begin = std::max(levels[l], dirty_begin);
+				uint32_t end = (l + 1 < levels.size() ? levels[l+1] : count);
+				if (begin >= end) continue;
+				uint32_t chunks = std::min(max_chunks, (end - begin) / (MIN_PARALLEL_LEVEL / 2));
+				if (chunks <= 1) {
+					build_local_to_world(soa, begin, end, out);
+					continue;
+				}
+				uint32_t chunk = ((end - begin + chunks - 1) / chunks + 7) & ~7U;
+				pool->run(chunks, [&](uint32_t c){
+					uint32_t chunk_begin = begin + c * chunk;
+					uint32_t chunk_end = std::min(end, chunk_begin + chunk);
+					if (chunk_begin < chunk_end) build_local_to_world(soa, chunk_begin, chunk_end, out);
+				});
+			}
+		}
+	}
+	dirty_begin = count;
+}
+
+void Scene::pack_transforms() {
+	transform_arrays.reset();
+	std::vector< Transform * > all;
+	all.reserve(transforms.size());
+	for (auto &t : transforms) {
+		all.emplace_back(&t);
 	}
+	transform_arrays = std::make_unique< TransformArrays >(all);
+}
+
+void Scene::unpack_transforms() {
+	transform_arrays.reset();
+}
+
+void Scene::update_transforms(WorkerPool *pool) const {
+	if (transform_arrays) transform_arrays->update(pool);
 }
 
 //-------------------------
@@ -89,7 +311,16 @@ void Scene::draw(Camera const &camera) const {
 
 void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light) const {
 
-	//Iterate through all drawables, sending each one to OpenGL:
+	//Gather the drawables that could be drawn, along with world-space boxes for those that have bounds:
+	auto &candidates = draw_scratch.candidates;
+	auto &box = draw_scratch.box;
+	auto &box_candidate = draw_scratch.box_candidate;
+	auto &box_visible = draw_scratch.box_visible;
+	auto &visible = draw_scratch.visible;
+	candidates.clear();
+	for (auto &b : box) b.clear();
+	box_candidate.clear();
+
 	for (auto const &drawable : drawables) {
 		//Only draws when enabled
 		if (!drawable.transform->enabled) continue;
@@ -104,18 +335,107 @@ void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_lig
 		//skip any drawables that don't contain any vertices:
 		if (pipeline.count == 0) continue;
 
+		assert(drawable.transform); //drawables *must* have a transform
+		candidates.emplace_back(DrawScratch::Candidate{ &drawable, drawable.transform->make_local_to_world() });
+
+		//drawables with unknown (empty) bounds are always drawn:
+		if (!(drawable.min.x <= drawable.max.x && drawable.min.y <= drawable.max.y && drawable.min.z <= drawable.max.z)) continue;
+
+		//box around the transformed box:
+		glm::mat4x3 const &object_to_world = candidates.back().object_to_world;
+		glm::vec3 center = object_to_world * glm::vec4(0.5f * (drawable.min + drawable.max), 1.0f);
+		glm::vec3 half = 0.5f * (drawable.max - drawable.min);
+		glm::vec3 extent = glm::abs(object_to_world[0]) * half.x + glm::abs(object_to_world[1]) * half.y + glm::abs(object_to_world[2]) * half.z;
+		box[0].emplace_back(center.x);
+		box[1].emplace_back(center.y);
+		box[2].emplace_back(center.z);
+		box[3].emplace_back(extent.x);
+		box[4].emplace_back(extent.y);
+		box[5].emplace_back(extent.z);
+		box_candidate.emplace_back(uint32_t(candidates.size() - 1));
+	}
+
+	//Cull boxes against the view frustum, whose planes are sums and differences of world_to_clip's rows:
+	// (a point is in view when -w <= x, y, z <= w in clip space; for an infinite projection the far plane is degenerate and culls nothing)
+	float planes[24];
+	for (uint32_t r = 0; r < 3; ++r) {
+		for (uint32_t c = 0; c < 4; ++c) {
+			planes[4 * (2 * r + 0) + c] = world_to_clip[c][3] + world_to_clip[c][r];
+			planes[4 * (2 * r + 1) + c] = world_to_clip[c][3] - world_to_clip[c][r];
+		}
+	}
+	box_visible.resize(box_candidate.size());
+	cull_boxes(uint32_t(box_candidate.size()), box[0].data(), box[1].data(), box[2].data(), box[3].data(), box[4].data(), box[5].data(), planes, box_visible.data());
+
+	visible.assign(candidates.size(), 1);
+	for (uint32_t b = 0; b < box_candidate.size(); ++b) {
+		visible[box_candidate[b]] = box_visible[b];
+	}
+
+	draw_stats = DrawStats();
+
+	//Queue the remaining drawables, sorted so that drawables sharing a program, vertex array, and textures are drawn together
+	// (and nearest-first within each group, which helps early depth testing):
+	// note: this means drawables aren't drawn in list order
+	auto &queue = draw_scratch.queue;
+	queue.clear();
+	for (uint32_t i = 0; i < candidates.size(); ++i) {
+		if (!visible[i]) {
+			draw_stats.culled += 1;
+			continue;
+		}
+		Drawable::Pipeline const &pipeline = candidates[i].drawable->pipeline;
+		queue.emplace_back();
+		DrawScratch::Queued &q = queue.back();
+		q.program = pipeline.program;
+		q.vao = pipeline.vao;
+		for (uint32_t t = 0; t < Drawable::Pipeline::TextureCount; ++t) {
+			q.textures[t] = pipeline.textures[t].texture;
+		}
+		q.depth = (world_to_clip * glm::vec4(candidates[i].object_to_world[3], 1.0f)).w;
+		q.candidate = i;
+	}
+	std::sort(queue.begin(), queue.end());
+
+	//Send the queue to OpenGL, only changing state that differs from the previous drawable's:
+	// (pipelines' set_uniforms functions should only set uniforms, or this tracking will be wrong)
+	GLuint bound_program = 0;
+	GLuint bound_vao = 0;
+	Drawable::Pipeline::TextureInfo bound_textures[Drawable::Pipeline::TextureCount]; //(texture 0 == nothing bound)
+	uint32_t active_texture = 0;
+	auto set_active_texture = [&](uint32_t t) {
+		if (t != active_texture) {
+			glActiveTexture(GL_TEXTURE0 + t);
+			active_texture = t;
+		}
+	};
+
+	for (DrawScratch::Queued const &q : queue) {
+		draw_stats.drawn += 1;
+
+		Scene::Drawable const &drawable = *candidates[q.candidate].drawable;
+
+		//Reference to drawable's pipeline for convenience:
+		Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
 
 		//Set shader program:
-		glUseProgram(pipeline.program);
+		if (pipeline.program != bound_program) {
+			glUseProgram(pipeline.program);
+			bound_program = pipeline.program;
+			draw_stats.state_changes += 1;
+		}
 
 		//Set attribute sources:
-		glBindVertexArray(pipeline.vao);
+		if (pipeline.vao != bound_vao) {
+			glBindVertexArray(pipeline.vao);
+			bound_vao = pipeline.vao;
+			draw_stats.state_changes += 1;
+		}
 
 		//Configure program uniforms:
 
 		//the object-to-world matrix is used in all three of these uniforms:
-		assert(drawable.transform); //drawables *must* have a transform
-		glm::mat4x3 object_to_world = drawable.transform->make_local_to_world();
+		glm::mat4x3 const &object_to_world = candidates[q.candidate].object_to_world;
 
 		//OBJECT_TO_CLIP takes vertices from object space to clip space:
 		if (pipeline.OBJECT_TO_CLIP_mat4 != -1U) {
@@ -140,27 +460,34 @@ void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_lig
 		//set any requested custom uniforms:
 		if (pipeline.set_uniforms) pipeline.set_uniforms();
 
-		//set up textures:
-		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
-			if (pipeline.textures[i].texture != 0) {
-				glActiveTexture(GL_TEXTURE0 + i);
-				glBindTexture(pipeline.textures[i].target, pipeline.textures[i].texture);
+		//set up textures (units the pipeline doesn't use are left with nothing bound, as if unbound after each draw):
+		for (uint32_t t = 0; t < Drawable::Pipeline::TextureCount; ++t) {
+			Drawable::Pipeline::TextureInfo const &want = pipeline.textures[t];
+			Drawable::Pipeline::TextureInfo &bound = bound_textures[t];
+			if (want.texture == bound.texture && (want.texture == 0 || want.target == bound.target)) continue;
+			set_active_texture(t);
+			if (bound.texture != 0 && (want.texture == 0 || want.target != bound.target)) {
+				glBindTexture(bound.target, 0);
+			}
+			if (want.texture != 0) {
+				glBindTexture(want.target, want.texture);
 			}
+			bound = want;
+			draw_stats.state_changes += 1;
 		}
 
 		//draw the object:
 		glDrawArrays(pipeline.type, pipeline.start, pipeline.count);
+	}
 
-		//un-bind textures:
-		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
-			if (pipeline.textures[i].texture != 0) {
-				glActiveTexture(GL_TEXTURE0 + i);
-				glBindTexture(pipeline.textures[i].target, 0);
-			}
+	//un-bind textures:
+	for (uint32_t t = 0; t < Drawable::Pipeline::TextureCount; ++t) {
+		if (bound_textures[t].texture != 0) {
+			set_active_texture(t);
+			glBindTexture(bound_textures[t].target, 0);
 		}
-		glActiveTexture(GL_TEXTURE0);
-
 	}
+	set_active_texture(0);
 
 	glUseProgram(0);
 	glBindVertexArray(0);
@@ -234,7 +561,7 @@ void Scene::load(std::string const &filename,
 			if (h.parent >= hierarchy_transforms.size()) {
 				throw std::runtime_error("scene file '" + filename + "' did not contain transforms in topological-sort order.");
 			}
-			t->parent = hierarchy_transforms[h.parent];
+			t->set_parent(hierarchy_transforms[h.parent]);
 		}
 
 		if (h.name_begin <= h.name_end && h.name_end <= names.size()) {
@@ -243,9 +570,9 @@ void Scene::load(std::string const &filename,
 				throw std::runtime_error("scene file '" + filename + "' contains hierarchy entry with invalid name indices");
 		}
 
-		t->position = h.position;
-		t->rotation = h.rotation;
-		t->scale = h.scale;
+		t->set_position(h.position);
+		t->set_rotation(h.rotation);
+		t->set_scale(h.scale);
 
 		hierarchy_transforms.emplace_back(t);
 	}
@@ -341,25 +668,29 @@ void Scene::set(Scene const &other, std::unordered_map< Transform const *, Trans
 	transform_to_transform.insert(std::make_pair(nullptr, nullptr));
 
 	//Copy transforms and store mapping:
+	unpack_transforms();
 	transforms.clear();
 	for (auto const &t : other.transforms) {
 		transforms.emplace_back();
 		transforms.back().name = t.name;
-		transforms.back().position = t.position;
-		transforms.back().rotation = t.rotation;
-		transforms.back().scale = t.scale;
-		transforms.back().parent = t.parent; //will update later
+		transforms.back().set_position(t.position());
+		transforms.back().set_rotation(t.rotation());
+		transforms.back().set_scale(t.scale());
+		//(parent is set below, once all transforms exist)
 
 		//store mapping between transforms old and new:
 		auto ret = transform_to_transform.insert(std::make_pair(&t, &transforms.back()));
 		assert(ret.second);
 	}
 
-	//update transform parents:
-	for (auto &t : transforms) {
-		t.parent = transform_to_transform.at(t.parent);
+	//set transform parents:
+	for (auto const &t : other.transforms) {
+		transform_to_transform.at(&t)->set_parent(transform_to_transform.at(t.parent()));
 	}
 
+	//pack transforms if other's are:
+	if (other.transform_arrays) pack_transforms();
+
 	//copy other's drawables, updating transform pointers:
 	drawables = other.drawables;
 	for (auto &d : drawables) {
@@ -15,6 +15,7 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 
+#include <limits>
 #include <list>
 #include <memory>
 #include <functional>
@@ -22,27 +23,37 @@
 #include <vector>
 #include <unordered_map>
 
+struct WorkerPool;
+
 struct Scene {
+	struct TransformArrays;
+
 	struct Transform {
 		//Transform names are useful for debugging and looking up locations in a loaded scene:
 		std::string name;
 
 		//The core function of a transform is to store a transformation in the world:
-		glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f);
-		glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f); //n.b. wxyz init order
-		glm::vec3 scale = glm::vec3(1.0f, 1.0f, 1.0f);
+		// (change it through the set_ functions, which keep the cached matrices below up to date)
+		glm::vec3 const &position() const { return position_; }
+		glm::quat const &rotation() const { return rotation_; }
+		glm::vec3 const &scale() const { return scale_; }
+		void set_position(glm::vec3 const &position);
+		void set_rotation(glm::quat const &rotation);
+		void set_scale(glm::vec3 const &scale);
 
 		//Draws when enabled
 		bool enabled = true;
 
 		//The transform above may be relative to some parent transform:
-		Transform *parent = nullptr;
+		Transform *parent() const { return parent_; }
+		void set_parent(Transform *parent); //(nullptr for none)
 
 		//It is often convenient to construct matrices representing this transformation:
 		// ..relative to its parent:
 		glm::mat4x3 make_local_to_parent() const;
 		glm::mat4x3 make_parent_to_local() const;
 		// ..relative to the world:
+		// (cached; only recomputed after this transform or one of its ancestors changes)
 		glm::mat4x3 make_local_to_world() const;
 		glm::mat4x3 make_world_to_local() const;
 
@@ -50,6 +61,60 @@ struct Scene {
 		Transform(Transform const &) = delete;
 		//if we delete some constructors, we need to let the compiler know that the default constructor is still okay:
 		Transform() = default;
+		//transforms detach from their parent and children when destroyed:
+		~Transform();
+
+		//internals:
+		glm::vec3 position_ = glm::vec3(0.0f, 0.0f, 0.0f);
+		glm::quat rotation_ = glm::quat(1.0f, 0.0f, 0.0f, 0.0f); //n.b. wxyz init order
+		glm::vec3 scale_ = glm::vec3(1.0f, 1.0f, 1.0f);
+		Transform *parent_ = nullptr;
+		std::vector< Transform * > children; //transforms whose parent is this one
+
+		//cached matrices, valid unless the matching dirty flag is set:
+		// (a dirty transform's descendants are always dirty too, so marking can stop at the first dirty one)
+		mutable glm::mat4x3 local_to_world;
+		mutable glm::mat4x3 world_to_local;
+		mutable bool local_to_world_dirty = true;
+		mutable bool world_to_local_dirty = true;
+		//flag cached matrices of this transform and its descendants as out of date:
+		void mark_dirty();
+
+		//packed copy of this transform (see TransformArrays, below), if any:
+		// (packed transforms read local_to_world from there instead of the cache above)
+		TransformArrays *arrays = nullptr;
+		uint32_t array_index = 0;
+	};
+
+	//An optional packed copy of transforms, as structure-of-arrays, ordered by depth (so parents come before their children),
+	// which lets all world matrices be built in one batched pass (see transform_kernels.hpp):
+	// Transform pointers keep working as usual; setters also update the packed copy, and
+	// make_local_to_world() reads from it, rebuilding entries from the first changed one on when needed.
+	struct TransformArrays {
+		//packs 'from' (along with their ancestors, if not already included):
+		TransformArrays(std::vector< Transform * > const &from);
+		//transforms go back to caching their own matrices once unpacked:
+		~TransformArrays();
+		TransformArrays(TransformArrays const &) = delete;
+
+		std::vector< Transform * > transforms; //handles (nullptr for transforms destroyed since packing)
+		std::vector< float > position[3]; //x, y, z
+		std::vector< float > rotation[4]; //x, y, z, w
+		std::vector< float > scale[3]; //x, y, z
+		std::vector< uint32_t > parent; //index of parent, or -1U for none
+		std::vector< glm::mat4x3 > local_to_world;
+		std::vector< uint32_t > levels; //index of the first transform at each depth
+
+		//rebuild any out-of-date local_to_world entries:
+		// if given a pool, each depth level is split across its threads (levels below MIN_PARALLEL_LEVEL are built on the calling thread)
+		void update(WorkerPool *pool = nullptr);
+		static constexpr uint32_t MIN_PARALLEL_LEVEL = 2048;
+
+		//internals:
+		uint32_t dirty_begin = 0; //local_to_world entries from here on are out of date
+		bool order_dirty = false; //the hierarchy has changed, so arrays need to be re-ordered before the next update
+		void pack(std::vector< Transform * > const &from);
+		void store(Transform const &transform); //copy changed position/rotation/scale into the arrays
 	};
 
 	struct Drawable {
@@ -57,6 +122,11 @@ struct Scene {
 		Drawable(Transform *transform_) : transform(transform_) { assert(transform); }
 		Transform * transform;
 
+		//Bounding box of the drawn vertices, in the transform's local space (e.g., a Mesh's min and max):
+		// draw() skips drawables whose box is entirely out of view; the default (empty) box means "unknown", so is never culled
+		glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+		glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+
 		//Contains all the data needed to run the OpenGL pipeline:
 		struct Pipeline {
 			GLuint program = 0; //shader program; passed to glUseProgram
@@ -120,17 +190,72 @@ struct Scene {
 	};
 
 	//Scenes, of course, may have many of the above objects:
+	// (transform_arrays is declared first so that it outlives the transforms it refers to)
+	std::unique_ptr< TransformArrays > transform_arrays; //set by pack_transforms()
 	std::list< Transform > transforms;
 	std::list< Drawable > drawables;
 	std::list< Camera > cameras;
 	std::list< Light > lights;
 
+	//pack all current transforms into transform_arrays (replacing any previous packing):
+	// (transforms created later aren't packed unless they become ancestors of packed transforms or this is called again)
+	void pack_transforms();
+	//go back to per-transform matrix caching:
+	void unpack_transforms();
+	//bring packed world matrices up to date now, using 'pool' to spread large hierarchies across cores:
+	// (otherwise this happens on the calling thread as soon as some matrix is needed, e.g., in draw())
+	void update_transforms(WorkerPool *pool) const;
+
 	//The "draw" function provides a convenient way to pass all the things in a scene to OpenGL:
+	// (drawables out of view are skipped, and the rest are drawn grouped by pipeline state rather than in list order)
 	void draw(Camera const &camera) const;
 
 	//..sometimes, you want to draw with a custom projection matrix and/or light space:
 	void draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light = glm::mat4x3(1.0f)) const;
 
+	//counts from the most recent draw() (handy for checking how much culling saves):
+	struct DrawStats {
+		uint32_t drawn = 0; //drawables sent to OpenGL
+		uint32_t culled = 0; //drawables skipped because their bounds were out of view
+		uint32_t state_changes = 0; //program, vertex array, and texture unit changes (draw() skips ones that wouldn't change anything)
+	};
+	mutable DrawStats draw_stats;
+
+	//internals:
+	//scratch space for draw(), kept between calls so drawing doesn't allocate every frame:
+	struct DrawScratch {
+		//drawables that could be drawn, with their world matrices:
+		struct Candidate {
+			Drawable const *drawable;
+			glm::mat4x3 object_to_world;
+		};
+		std::vector< Candidate > candidates;
+		std::vector< float > box[6]; //world-space box center x, y, z and half-extent x, y, z
+		std::vector< uint32_t > box_candidate; //index of the candidate each box belongs to
+		std::vector< uint8_t > box_visible;
+		std::vector< uint8_t > visible; //per candidate
+
+		//visible candidates, in the order they are drawn (see draw()):
+		struct Queued {
+			GLuint program;
+			GLuint vao;
+			GLuint textures[Drawable::Pipeline::TextureCount];
+			float depth; //clip-space w of the object's origin (distance along the view direction, for perspective projections)
+			uint32_t candidate;
+			bool operator<(Queued const &o) const {
+				if (program != o.program) return program < o.program;
+				if (vao != o.vao) return vao < o.vao;
+				for (uint32_t t = 0; t < Drawable::Pipeline::TextureCount; ++t) {
+					if (textures[t] != o.textures[t]) return textures[t] < o.textures[t];
+				}
+				if (depth != o.depth) return depth < o.depth;
+				return candidate < o.candidate;
+			}
+		};
+		std::vector< Queued > queue;
+	};
+	mutable DrawScratch draw_scratch;
+
 	//add transforms/objects/cameras from a scene file to this scene:
 	// the 'on_drawable' callback gives your code a chance to look up mesh data and make Drawables:
 	// throws on file format errors
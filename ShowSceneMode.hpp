@@ -10,6 +10,7 @@
 #include "Mode.hpp"
 #include "Scene.hpp"
 #include "Mesh.hpp"
+#include "WorkerPool.hpp"
 
 struct ShowSceneMode : Mode {
 	ShowSceneMode(Scene const &scene);
@@ -30,6 +31,9 @@ struct ShowSceneMode : Mode {
 	//Scene being viewed:
 	Scene const &scene;
 
+	//threads for updating the scene's (packed) transforms:
+	WorkerPool workers;
+
 	//mode uses a secondary Scene to hold a camera:
 	Scene camera_scene;
 	Scene::Camera *scene_camera = nullptr;
@@ -1,12 +1,24 @@
 #include "Sound.hpp"
 #include "load_wav.hpp"
 #include "load_opus.hpp"
+#include "pcm_cache.hpp"
+#include "sample_encoding.hpp"
+#include "mix_kernels.hpp"
+#include "OpusStream.hpp"
+#include "Resampler.hpp"
+#include "SPSCQueue.hpp"
 
 #include <SDL.h>
 
-#include <list>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <array>
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <exception>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <algorithm>
 
@@ -14,14 +26,276 @@
 namespace {
 
 	//handy constants:
-	constexpr uint32_t const AUDIO_RATE = 48000; //sampling rate
-	constexpr uint32_t const MIX_SAMPLES = 1024; //number of samples to mix per call of mix_audio callback; n.b. SDL requires this to be a power of two
+	constexpr uint32_t const AUDIO_RATE = Sound::AUDIO_RATE; //sampling rate
+	constexpr uint32_t const MAX_MIX_SAMPLES = Sound::MAX_BUFFER_FRAMES; //most samples mixed per call of mix_audio callback (the actual number is the device's buffer size)
+	constexpr uint32_t const MAX_VOICES = Sound::MAX_PLAYING_SAMPLES;
 
 	//The audio device:
 	SDL_AudioDeviceID device = 0;
 
-	//list of all currently playing samples:
-	std::list< std::shared_ptr< Sound::PlayingSample > > playing_samples;
+	//A 'Voice' is the audio thread's book-keeping for one playing sample:
+	struct Voice {
+		void const *data = nullptr; //sample data being played
+		Sound::Sample::Storage storage = Sound::Sample::Decoded; //how data is encoded (float, int16, or ADPCM blocks)
+		uint32_t size = 0; //number of samples in data
+		OpusStream *stream = nullptr; //...or stream being played (data/size/i/loop are unused for streams)
+		uint32_t i = 0; //next data value to read
+		float frac = 0.0f; //...plus this fraction of a value (the playhead only leaves whole values when rate isn't 1.0)
+		uint64_t start_time = 0; //audio clock time at which to start playing (voice is silent, and doesn't advance, until then)
+		uint32_t generation = 0; //matches PlayingSample::generation of handles that refer to this voice
+		bool loop = false; //should playback loop after data runs out?
+		bool stopping = false; //is playing stopping?
+		int priority = 0; //higher priority voices are picked first when there are more voices than the budget
+		Sound::Bus bus = Sound::SFX; //bus the voice is mixed into
+
+		//was the voice mixed in the last block? (used to fade voices in and out when they switch between real and virtual):
+		enum Mixing : uint8_t { New, Real, Virtual } mixing = New;
+
+		Sound::Ramp< float > volume = Sound::Ramp< float >(1.0f);
+
+		//playback rate (data values per output frame; unused for streams):
+		Sound::Ramp< float > rate = Sound::Ramp< float >(1.0f);
+
+		//2D playback panning control: ('NaN' if sound played in 3D mode)
+		Sound::Ramp< float > pan = Sound::Ramp< float >(std::numeric_limits< float >::quiet_NaN());
+
+		//3D playback panning control: ('NaN' if sound played in 2D mode)
+		Sound::Ramp< glm::vec3 > position = Sound::Ramp< glm::vec3 >(std::numeric_limits< float >::quiet_NaN());
+		Sound::Ramp< float > half_volume_radius = std::numeric_limits< float >::quiet_NaN();
+	};
+
+	//Voice pool; allocated once, never resized. Only touched by the audio thread (or with the audio lock held):
+	std::array< Voice, MAX_VOICES > voices;
+	//indices of the voices currently playing, packed at the front of the array:
+	std::array< uint32_t, MAX_VOICES > active_voices;
+	uint32_t active_voice_count = 0;
+
+	//interleaved stereo frame, as used by the output buffer:
+	struct LR {
+		float l;
+		float r;
+	};
+	static_assert(sizeof(LR) == 8, "Sample is packed");
+
+	//per-block mixing info for each active voice (same order as active_voices):
+	struct VoiceMix {
+		LR start; //gains at start of block
+		LR end; //gains at end of block
+		float loudness; //largest of the gains
+		float rate_start; //playback rate at start of block
+		float rate_end; //playback rate at end of block
+		bool real; //mix this block? (otherwise, voice is virtual and only advances)
+	};
+	std::array< VoiceMix, MAX_VOICES > voice_mixes;
+	std::array< uint32_t, MAX_VOICES > mix_candidates; //scratch space for picking real voices
+
+	//3D voice panning inputs/outputs, gathered as structure-of-arrays so the pan_3d kernel can do them all in one pass:
+	struct Pan3DBatch {
+		std::array< float, MAX_VOICES > x, y, z, half_radius, volume; //inputs
+		std::array< float, MAX_VOICES > left, right; //gains (outputs)
+		void set(uint32_t i, glm::vec3 const &position, float half_radius_, float volume_) {
+			x[i] = position.x;
+			y[i] = position.y;
+			z[i] = position.z;
+			half_radius[i] = half_radius_;
+			volume[i] = volume_;
+		}
+		void pan(uint32_t count, glm::vec3 const &listener_position, glm::vec3 const &listener_right) {
+			pan_3d(count, x.data(), y.data(), z.data(), half_radius.data(), volume.data(),
+				glm::value_ptr(listener_position), glm::value_ptr(listener_right), left.data(), right.data());
+		}
+	};
+	std::array< Pan3DBatch, 2 > pan_batches; //at the start and end of the block
+	std::array< uint32_t, MAX_VOICES > batch_voices; //index (into voice_mixes) of each batched voice
+	uint32_t virtual_voice_count = 0; //number of voices that were virtual in the last block
+
+	//generation of the voice in each slot (0 if the slot is free) -- the one piece of voice state the game thread can read:
+	std::array< std::atomic< uint32_t >, MAX_VOICES > voice_generations{};
+
+	//Voice virtualization controls (set by the game thread, read by the audio thread):
+	std::atomic< uint32_t > voice_budget{64};
+	std::atomic< float > audibility_threshold{0.001f};
+	std::atomic< Sound::Interpolation > interpolation{Sound::Cubic};
+
+	//slots of finished voices, handed back from the audio thread to the game thread:
+	SPSCQueue< uint32_t, MAX_VOICES > finished_voices;
+
+	//Voice slots the game thread may hand out (only touched by the game thread):
+	struct {
+		std::array< uint32_t, MAX_VOICES > slots;
+		uint32_t count = 0;
+		uint32_t next_generation = 1;
+		bool warned = false;
+	} free_voices;
+
+	//Budgeted samples (see Sound::set_sample_memory_budget; only touched by the game thread):
+	struct {
+		size_t budget = 0; //0 == no budget
+		size_t pin_bytes = 0;
+		size_t used = 0; //bytes of budgeted sample data currently decoded
+		uint64_t plays = 0; //plays of budgeted samples so far (a clock for finding the least-recently-played sample)
+		std::vector< Sound::Sample::Managed * > samples; //every budgeted sample
+		std::array< Sound::Sample::Managed *, MAX_VOICES > voice_samples{}; //budgeted sample being played by each voice slot (if any)
+		bool warned = false;
+	} sample_memory;
+
+	//Changes requested by the game thread, waiting to be applied by the audio thread:
+	struct Command {
+		enum Type : uint8_t {
+			Play, //start voice 'index' playing 'data'
+			SetVolume, //voice.volume.set(value, ramp)
+			SetPan, //voice.pan.set(value, ramp)
+			SetPosition, //voice.position.set(position, ramp)
+			SetHalfVolumeRadius, //voice.half_volume_radius.set(value, ramp)
+			SetRate, //voice.rate.set(value, ramp)
+			Stop, //stop voice (fade out over ramp)
+			StopAll, //stop all voices
+			SetGlobalVolume, //Sound::volume.set(value, ramp)
+			SetListener, //Sound::listener.{position,right}.set(position/right, ramp)
+			ResetStats, //zero the mixer statistics
+			SetBusVolume, //buses[bus].volume.set(value, ramp)
+			SetBusSend, //buses[bus].sends[send_to].set(value, ramp)
+		} type = Play;
+		bool loop = false; //(Play only)
+		uint32_t index = 0; //voice slot
+		uint32_t generation = 0; //voice generation; commands for stale handles are ignored
+		void const *data = nullptr; //(Play only)
+		Sound::Sample::Storage storage = Sound::Sample::Decoded; //(Play only)
+		uint32_t size = 0; //(Play only)
+		OpusStream *stream = nullptr; //(Play only)
+		float value = 0.0f; //volume / pan / radius / rate
+		float ramp = 0.0f;
+		glm::vec3 position = glm::vec3(0.0f);
+		glm::vec3 right = glm::vec3(0.0f);
+		float pan = 0.0f; //(Play only)
+		float half_volume_radius = 0.0f; //(Play only)
+		int priority = 0; //(Play only)
+		uint64_t start_time = 0; //(Play only)
+		Sound::Bus bus = Sound::SFX; //(Play only); also bus for SetBusVolume and SetBusSend
+		Sound::Bus send_to = Sound::SFX; //(SetBusSend only)
+	};
+
+	//commands are produced only by the game thread and consumed by the audio thread
+	// (or, if the queue fills up, by the game thread while holding the audio lock):
+	constexpr uint32_t const COMMAND_QUEUE_SIZE = 1024;
+	SPSCQueue< Command, COMMAND_QUEUE_SIZE > commands;
+
+	//Mixer statistics (see Sound::Stats).
+	//Only written by whichever thread is mixing (the audio thread, or a thread holding the audio lock);
+	// read at any time by Sound::get_stats():
+	struct {
+		std::array< std::atomic< uint64_t >, Sound::Stats::HISTOGRAM_BINS > histogram{};
+		std::atomic< uint64_t > callbacks{0};
+		std::atomic< uint64_t > deadline_misses{0};
+		std::atomic< uint64_t > late_callbacks{0};
+		std::atomic< uint64_t > total_ns{0};
+		std::atomic< uint64_t > max_ns{0};
+		std::atomic< uint32_t > active_voices{0};
+		std::atomic< uint32_t > virtual_voices{0};
+		std::atomic< uint32_t > max_active_voices{0};
+		std::atomic< uint32_t > max_real_voices{0};
+		std::atomic< float > peak_l{0.0f};
+		std::atomic< float > peak_r{0.0f};
+		std::atomic< uint64_t > resample_ns{0};
+		std::atomic< uint64_t > max_resample_ns{0};
+
+		//start of the previous device callback (for spotting late callbacks):
+		std::chrono::steady_clock::time_point last_start;
+		bool have_last_start = false;
+	} stats;
+
+	//deadline for mixing a block of 'frames' frames:
+	double deadline_ns(uint32_t frames) {
+		return 1.0e9 * frames / AUDIO_RATE;
+	}
+
+	//Adaptive buffer size -- the mixer asks for a bigger buffer after repeated deadline misses:
+	std::atomic< bool > adaptive_buffer{true};
+	std::atomic< bool > step_up_requested{false};
+	constexpr uint32_t const STEP_UP_MISSES = 3; //ask for a bigger buffer after this many misses...
+	constexpr uint32_t const STEP_UP_WINDOW = 2 * AUDIO_RATE; //...within this many frames
+	struct {
+		uint32_t count = 0;
+		uint64_t window_start = 0;
+	} recent_misses; //(mixing thread only)
+
+	//count a missed deadline or late callback; several close together mean this buffer size is too small for this machine:
+	// (the game thread does the actual switch, in Sound::update())
+	void note_miss(uint64_t clock) {
+		if (!adaptive_buffer.load(std::memory_order_relaxed)) return;
+		if (clock - recent_misses.window_start > STEP_UP_WINDOW) {
+			recent_misses.window_start = clock;
+			recent_misses.count = 0;
+		}
+		recent_misses.count += 1;
+		if (recent_misses.count >= STEP_UP_MISSES) {
+			step_up_requested.store(true, std::memory_order_relaxed);
+			recent_misses.count = 0;
+		}
+	}
+
+	//where to write stats on shutdown (game thread only):
+	std::string stats_file;
+
+	//there is only ever one writer, so stats can be updated without read-modify-write atomics:
+	template< typename T >
+	void stats_add(std::atomic< T > &value, T amount) {
+		value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+	}
+	template< typename T >
+	void stats_max(std::atomic< T > &value, T amount) {
+		if (amount > value.load(std::memory_order_relaxed)) value.store(amount, std::memory_order_relaxed);
+	}
+
+	//Audio clock -- frames mixed so far (written by the mixing thread, read by Sound::audio_clock()):
+	std::atomic< uint64_t > mix_clock{0};
+
+	//When the last block started mixing, for estimating the playback position between blocks.
+	//Written by the mixing thread, read by Sound::playback_clock(); 'sequence' is odd while the values are being changed:
+	struct {
+		std::atomic< uint32_t > sequence{0};
+		std::atomic< uint64_t > frame{0}; //audio clock at the start of the block
+		std::atomic< int64_t > ns{0}; //steady_clock time (in ns since its epoch) when the block started mixing
+	} last_block;
+
+	//frames of output the device buffers between the mixer and the speakers (set when the device is opened):
+	uint32_t output_latency = 0;
+
+	//frames per block (the device's buffer size, or the offline block size); only changed by the game thread while the mixer isn't running:
+	uint32_t mix_samples = MAX_MIX_SAMPLES;
+
+	//Submix buses (only touched by the audio thread, except 'effects', which is changed with the audio lock held):
+	struct SubmixBus {
+		Sound::Ramp< float > volume = Sound::Ramp< float >(1.0f);
+		std::array< Sound::Effect *, Sound::MAX_BUS_EFFECTS > effects{};
+		uint32_t effect_count = 0;
+		std::array< Sound::Ramp< float >, Sound::BUS_COUNT > sends{}; //level of this bus's output sent on to each later bus
+		std::array< LR, MAX_MIX_SAMPLES > mix; //this block's mix (only valid if 'mixed' is set)
+		bool mixed = false; //has 'mix' been cleared for this block?
+	};
+	std::array< SubmixBus, Sound::BUS_COUNT > buses;
+
+	//Offline rendering state -- leftover frames from the last block mixed by Sound::render():
+	struct {
+		std::array< float, 2 * MAX_MIX_SAMPLES > block;
+		uint32_t size = 0; //frames in 'block'
+		uint32_t used = 0; //frames of 'block' already handed out
+	} offline;
+
+	//Output stage -- the device runs at whatever rate and buffer size suit it, so blocks are mixed at AUDIO_RATE and,
+	// if needed, converted to the device's rate and re-chunked to its buffer size here rather than inside SDL.
+	//(Only touched by the audio thread, or by the game thread while the device is closed.)
+	struct {
+		uint32_t rate = AUDIO_RATE; //device's sample rate
+		uint32_t frames = 0; //device's buffer size (in frames at 'rate')
+		std::unique_ptr< Resampler > left, right; //rate converters (only if rate != AUDIO_RATE)
+		std::array< LR, MAX_MIX_SAMPLES > block; //last block mixed
+		std::array< float, MAX_MIX_SAMPLES > channel; //one channel of 'block' (resampler input)
+		std::vector< float > converted; //one channel of resampler output
+		std::vector< LR > pending; //frames ready for the device: pending[used, size)
+		uint32_t size = 0;
+		uint32_t used = 0;
+	} output;
 
 }
 
@@ -35,30 +309,257 @@ Sound::Listener Sound::listener;
 
 //This audio-mixing callback is defined below:
 void mix_audio(void *, Uint8 *buffer_, int len);
+//...and so is the device callback that feeds its output to the device:
+void output_audio(void *, Uint8 *stream, int len);
 
-//------------------------ public-facing --------------------------------
+//Commands are applied by this function (also defined below):
+void apply_commands();
+
+//Hand a command to the audio thread:
+static void enqueue(Command &&command) {
+	if (commands.push(std::move(command))) return;
+
+	//queue is full (audio device is stalled or isn't running at all), so apply pending commands here:
+	// (the audio lock keeps the callback from running, which makes this thread the only consumer)
+	Sound::lock();
+	apply_commands();
+	Sound::unlock();
+
+	bool pushed = commands.push(std::move(command));
+	assert(pushed && "Queue is empty after applying commands.");
+	(void)pushed;
+}
+
+//Queue a command that changes the voice referred to by a handle:
+static void enqueue(Command::Type type, Sound::PlayingSample const &handle, Command &&command) {
+	if (handle.generation == 0) return; //handle doesn't refer to anything
+	command.type = type;
+	command.index = handle.index;
+	command.generation = handle.generation;
+	enqueue(std::move(command));
+}
 
-Sound::Sample::Sample(std::string const &filename) {
+//Re-encode a sample's (float) data in a more compact form, if requested:
+static void encode(Sound::Sample *sample, Sound::Sample::Storage storage) {
+	assert(sample);
+	if (storage == Sound::Sample::Int16) {
+		encode_int16(sample->data.data(), uint32_t(sample->data.size()), &sample->data_int16);
+	} else if (storage == Sound::Sample::ADPCM) {
+		encode_adpcm(sample->data.data(), uint32_t(sample->data.size()), &sample->data_adpcm);
+		sample->adpcm_count = uint32_t(sample->data.size());
+	} else {
+		assert(storage == Sound::Sample::Decoded);
+		return;
+	}
+	sample->storage = storage;
+	//free the float data:
+	std::vector< float >().swap(sample->data);
+}
+
+//Budgeted sample book-keeping:
+struct Sound::Sample::Managed {
+	Managed(std::string const &filename_, Storage storage_) : filename(filename_), storage(storage_) {
+		sample_memory.samples.emplace_back(this);
+	}
+	~Managed() {
+		sample_memory.used -= bytes;
+		sample_memory.samples.erase(std::find(sample_memory.samples.begin(), sample_memory.samples.end(), this));
+		for (auto &voice_sample : sample_memory.voice_samples) {
+			if (voice_sample == this) voice_sample = nullptr;
+		}
+	}
+	std::string filename;
+	Storage storage;
+	std::unique_ptr< Sample > resident; //decoded sample (if resident)
+	size_t bytes = 0; //memory used by 'resident'
+	uint64_t last_played = 0; //sample_memory.plays as of the last time this was played
+	uint32_t voices = 0; //voices playing this sample's data (that haven't yet been reclaimed from the audio thread)
+	bool pinned = false; //small enough to keep once decoded
+};
+
+//Decode a '.wav' or '.opus' file into a sample (used by the Sample constructor, and for budgeted samples when played):
+static void load_file(Sound::Sample *sample, std::string const &filename, Sound::Sample::Storage storage) {
+	assert(sample);
 	if (filename.size() >= 4 && filename.substr(filename.size()-4) == ".wav") {
-		load_wav(filename, &data);
-	} else if (filename.size() >= 5 && filename.substr(filename.size()-5) == ".opus") {
-		load_opus(filename, &data);
+		load_pcm_cached(filename, &sample->data, load_wav);
 	} else {
+		assert(filename.size() >= 5 && filename.substr(filename.size()-5) == ".opus");
+		load_pcm_cached(filename, &sample->data, load_opus);
+	}
+	encode(sample, storage);
+}
+
+//Drop least-recently-played budgeted samples (other than 'keep') with no voices playing until decoded samples fit the budget:
+static void fit_sample_budget(Sound::Sample::Managed const *keep) {
+	while (sample_memory.used > sample_memory.budget) {
+		Sound::Sample::Managed *oldest = nullptr;
+		for (Sound::Sample::Managed *managed : sample_memory.samples) {
+			if (managed == keep || !managed->resident || managed->pinned || managed->voices != 0) continue;
+			if (!oldest || managed->last_played < oldest->last_played) oldest = managed;
+		}
+		if (!oldest) {
+			if (!sample_memory.warned) {
+				std::cerr << "WARNING: decoded samples (" << sample_memory.used << " bytes) are over the sample memory budget (" << sample_memory.budget << " bytes), but all are playing or pinned." << std::endl;
+				sample_memory.warned = true;
+			}
+			return;
+		}
+		oldest->resident.reset();
+		sample_memory.used -= oldest->bytes;
+		oldest->bytes = 0;
+	}
+}
+
+//The sample whose data a voice should play -- 'sample' itself, or (for budgeted samples) its decoded data, decoding it if need be:
+static Sound::Sample const &resident_sample(Sound::Sample const &sample) {
+	Sound::Sample::Managed *managed = sample.managed.get();
+	if (!managed) return sample;
+
+	managed->last_played = ++sample_memory.plays;
+	if (!managed->resident) {
+		managed->resident = std::make_unique< Sound::Sample >(std::vector< float >());
+		load_file(managed->resident.get(), managed->filename, managed->storage);
+		Sound::Sample const &resident = *managed->resident;
+		managed->bytes = resident.data.size() * sizeof(float) + resident.data_int16.size() * sizeof(int16_t) + resident.data_adpcm.size();
+		managed->pinned = (managed->bytes < sample_memory.pin_bytes);
+		sample_memory.used += managed->bytes;
+		fit_sample_budget(managed);
+	}
+	return *managed->resident;
+}
+
+//Reclaim voices the audio thread has finished with:
+static void reclaim_voices() {
+	uint32_t index;
+	while (finished_voices.pop(&index)) {
+		assert(free_voices.count < MAX_VOICES);
+		free_voices.slots[free_voices.count++] = index;
+		if (Sound::Sample::Managed *managed = sample_memory.voice_samples[index]) {
+			assert(managed->voices > 0);
+			managed->voices -= 1;
+			sample_memory.voice_samples[index] = nullptr;
+		}
+	}
+}
+
+//Start a voice playing 'sample_' (used by all the play/loop functions):
+static Sound::PlayingSample start_voice(Sound::Sample const &sample_, bool loop, float volume, float pan, glm::vec3 const &position, float half_volume_radius, int priority, Sound::Bus bus, uint64_t start_time = 0) {
+	reclaim_voices();
+
+	Sound::PlayingSample handle;
+	if (free_voices.count == 0) {
+		if (!free_voices.warned) {
+			std::cerr << "WARNING: all " << MAX_VOICES << " voices are in use; some sounds will not play." << std::endl;
+			free_voices.warned = true;
+		}
+		return handle;
+	}
+
+	//(budgeted samples are decoded here, if they aren't already)
+	Sound::Sample const &sample = resident_sample(sample_);
+	if (sample.sample_count() == 0 && !sample.stream) return handle; //nothing to play
+
+	handle.index = free_voices.slots[--free_voices.count];
+	handle.generation = free_voices.next_generation++;
+	if (free_voices.next_generation == 0) free_voices.next_generation = 1; //(0 is reserved for 'no voice')
+	voice_generations[handle.index].store(handle.generation, std::memory_order_release);
+
+	//streams are read on behalf of the voice generation (if another voice is still reading, it falls silent):
+	if (sample.stream) sample.stream->start(loop, handle.generation);
+
+	//budgeted samples stay decoded at least until this voice is reclaimed:
+	if (sample_.managed) {
+		sample_memory.voice_samples[handle.index] = sample_.managed.get();
+		sample_.managed->voices += 1;
+	}
+
+	Command command;
+	command.type = Command::Play;
+	command.loop = loop;
+	command.index = handle.index;
+	command.generation = handle.generation;
+	if (sample.storage == Sound::Sample::Int16) command.data = sample.data_int16.data();
+	else if (sample.storage == Sound::Sample::ADPCM) command.data = sample.data_adpcm.data();
+	else command.data = sample.samples();
+	command.storage = sample.storage;
+	command.size = sample.sample_count();
+	command.stream = sample.stream.get();
+	command.value = volume;
+	command.pan = pan;
+	command.position = position;
+	command.half_volume_radius = half_volume_radius;
+	command.priority = priority;
+	command.start_time = start_time;
+	command.bus = bus;
+	enqueue(std::move(command));
+
+	return handle;
+}
+
+//------------------------ public-facing --------------------------------
+
+Sound::Sample::Sample(std::string const &filename, Storage storage) {
+	if (storage == Streamed) {
+		if (filename.size() >= 5 && filename.substr(filename.size()-5) == ".opus") {
+			stream = std::make_unique< OpusStream >(filename);
+		} else {
+			throw std::runtime_error("Sample '" + filename + "' doesn't end in \".opus\" -- only opus files can be streamed.");
+		}
+	} else if (!(filename.size() >= 4 && filename.substr(filename.size()-4) == ".wav")
+	        && !(filename.size() >= 5 && filename.substr(filename.size()-5) == ".opus")) {
 		throw std::runtime_error("Sample '" + filename + "' doesn't end in either \".png\" or \".opus\" -- unsure how to load.");
+	} else if (sample_memory.budget != 0) {
+		//decode later, when played (but make sure there is something to decode):
+		if (!std::ifstream(filename, std::ios::binary)) {
+			throw std::runtime_error("Failed to open sample '" + filename + "'.");
+		}
+		managed = std::make_unique< Managed >(filename, storage);
+		this->storage = storage;
+	} else {
+		load_file(this, filename, storage);
 	}
 }
 
-Sound::Sample::Sample(std::vector< float > const &data_) : data(data_) {
+Sound::Sample::Sample(std::vector< float > const &data_, Storage storage) : data(data_) {
+	if (storage == Streamed) {
+		throw std::runtime_error("Only samples loaded from '.opus' files can be streamed.");
+	}
+	encode(this, storage);
 }
 
+Sound::Sample::Sample(float const *view_, uint32_t view_size_) : view(view_), view_size(view_size_) {
+	assert(view || view_size == 0);
+}
 
+Sound::Sample::~Sample() {
+}
 
-void Sound::init() {
-	if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
-		std::cerr << "Failed to initialize SDL audio subsytem:\n" << SDL_GetError() << std::endl;
-		std::cerr << "  (Will continue without audio.)\n" << std::endl;
-		return;
+float const *Sound::Sample::samples() const {
+	if (managed) return (managed->resident ? managed->resident->samples() : nullptr);
+	return view ? view : data.data();
+}
+
+uint32_t Sound::Sample::sample_count() const {
+	if (managed) return (managed->resident ? managed->resident->sample_count() : 0);
+	if (view) return view_size;
+	if (storage == Int16) return uint32_t(data_int16.size());
+	if (storage == ADPCM) return adpcm_count;
+	return uint32_t(data.size());
+}
+
+
+
+//Mark all voices as free (used by both init functions):
+static void init_voices() {
+	free_voices.count = 0;
+	for (uint32_t i = 0; i < MAX_VOICES; ++i) {
+		free_voices.slots[free_voices.count++] = MAX_VOICES - 1 - i;
 	}
+}
+
+//Open the audio device with a buffer of 'frames' frames and start playback (used by init and set_buffer_frames):
+static bool open_device(uint32_t frames) {
+	assert(device == 0);
 
 	//Based on the example on https://wiki.libsdl.org/SDL_OpenAudioDevice
 	SDL_AudioSpec want, have;
@@ -66,22 +567,47 @@ void Sound::init() {
 	want.freq = AUDIO_RATE;
 	want.format = AUDIO_F32SYS;
 	want.channels = 2;
-	want.samples = MIX_SAMPLES;
-	want.callback = mix_audio;
+	want.samples = Uint16(frames);
+	want.callback = output_audio;
 
-	device = SDL_OpenAudioDevice(nullptr, 0, &want, &have, 0);
+	//take the device's own rate and buffer size (rather than have SDL convert and rebuffer behind our backs; see 'output'):
+	device = SDL_OpenAudioDevice(nullptr, 0, &want, &have, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_SAMPLES_CHANGE);
 	if (device == 0) {
 		std::cerr << "Failed to open audio device:\n" << SDL_GetError() << std::endl;
-		std::cerr << "  (Will continue without audio.)\n" << std::endl;
+		return false;
+	}
+
+	mix_samples = frames;
+	output.rate = uint32_t(have.freq);
+	output.frames = uint32_t(have.samples);
+	output.size = output.used = 0;
+	uint32_t resampler_delay = 0;
+	if (output.rate != AUDIO_RATE) {
+		std::cout << "Audio device runs at " << output.rate << " Hz; mixing at " << AUDIO_RATE << " Hz and resampling." << std::endl;
+		output.left = std::make_unique< Resampler >(AUDIO_RATE, output.rate);
+		output.right = std::make_unique< Resampler >(AUDIO_RATE, output.rate);
+		output.converted.resize(output.left->max_output(MAX_MIX_SAMPLES));
+		output.pending.resize(output.converted.size());
+		resampler_delay = output.left->taps / 2;
 	} else {
-		//start audio playback:
-		SDL_PauseAudioDevice(device, 0);
-		std::cout << "Audio output initialized." << std::endl;
+		output.left.reset();
+		output.right.reset();
+		output.pending.resize(MAX_MIX_SAMPLES);
 	}
-}
 
+	//the block being played plus the one just handed over, plus the resampler's look-ahead, in mixer frames:
+	// (a rough figure, since SDL doesn't report the hardware's own buffering)
+	output_latency = uint32_t(2 * uint64_t(have.samples) * AUDIO_RATE / output.rate) + resampler_delay;
+	//the gap while the device was closed isn't an underrun:
+	stats.have_last_start = false;
+	recent_misses.count = 0;
 
-void Sound::shutdown() {
+	//start audio playback:
+	SDL_PauseAudioDevice(device, 0);
+	return true;
+}
+
+static void close_device() {
 	if (device != 0) {
 		//stop audio playback:
 		SDL_PauseAudioDevice(device, 1);
@@ -90,6 +616,110 @@ void Sound::shutdown() {
 	}
 }
 
+void Sound::init() {
+	init_voices();
+
+	if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
+		std::cerr << "Failed to initialize SDL audio subsytem:\n" << SDL_GetError() << std::endl;
+		std::cerr << "  (Will continue without audio.)\n" << std::endl;
+		return;
+	}
+
+	if (!open_device(mix_samples)) {
+		std::cerr << "  (Will continue without audio.)\n" << std::endl;
+	} else {
+		std::cout << "Audio output initialized (" << mix_samples << " frame blocks; device at " << output.rate << " Hz with a " << output.frames << " frame buffer)." << std::endl;
+	}
+}
+
+void Sound::set_buffer_frames(uint32_t frames) {
+	if (frames < MIN_BUFFER_FRAMES || frames > MAX_BUFFER_FRAMES || (frames & (frames - 1)) != 0) {
+		throw std::runtime_error("Audio buffer size " + std::to_string(frames) + " isn't a power of two between " + std::to_string(MIN_BUFFER_FRAMES) + " and " + std::to_string(MAX_BUFFER_FRAMES) + ".");
+	}
+	step_up_requested.store(false, std::memory_order_relaxed);
+	if (frames == mix_samples) return;
+
+	if (device == 0) {
+		//no device (yet, or offline): just use the new size from now on:
+		mix_samples = frames;
+		return;
+	}
+
+	//SDL can't change the buffer size of an open device, so reopen it:
+	// (voices and queued commands are kept; they just pause while the device is closed)
+	close_device();
+	if (open_device(frames)) {
+		std::cout << "Audio buffer is now " << frames << " frames." << std::endl;
+	} else if (open_device(mix_samples)) {
+		std::cerr << "  (Keeping " << mix_samples << " frame buffer.)" << std::endl;
+	} else {
+		std::cerr << "  (Will continue without audio.)" << std::endl;
+	}
+}
+
+uint32_t Sound::get_buffer_frames() {
+	return mix_samples;
+}
+
+void Sound::set_adaptive_buffer(bool enabled) {
+	adaptive_buffer.store(enabled, std::memory_order_relaxed);
+	if (!enabled) step_up_requested.store(false, std::memory_order_relaxed);
+}
+
+void Sound::update() {
+	if (step_up_requested.load(std::memory_order_relaxed)) {
+		if (mix_samples < MAX_BUFFER_FRAMES) {
+			std::cerr << "WARNING: audio mixing is missing its deadline with a " << mix_samples << " frame buffer; switching to " << 2 * mix_samples << " frames." << std::endl;
+			set_buffer_frames(2 * mix_samples);
+		}
+		step_up_requested.store(false, std::memory_order_relaxed);
+	}
+}
+
+
+void Sound::shutdown() {
+	close_device();
+
+	if (stats_file != "") {
+		std::ofstream out(stats_file);
+		write_stats(out, get_stats());
+		if (!out) {
+			std::cerr << "WARNING: failed to write audio stats to '" << stats_file << "'." << std::endl;
+		} else {
+			std::cout << "Wrote audio stats to '" << stats_file << "'." << std::endl;
+		}
+	}
+}
+
+
+void Sound::init_offline() {
+	init_voices();
+	offline.size = offline.used = 0;
+}
+
+void Sound::render(float *lr, uint32_t frames) {
+	assert(device == 0 && "Can't render offline while an audio device is open.");
+	assert(lr || frames == 0);
+
+	while (frames > 0) {
+		if (offline.used == offline.size) {
+			offline.size = mix_samples;
+			mix_audio(nullptr, reinterpret_cast< Uint8 * >(offline.block.data()), int(2 * offline.size * sizeof(float)));
+			offline.used = 0;
+		}
+		uint32_t count = std::min(frames, offline.size - offline.used);
+		std::copy(offline.block.data() + 2 * offline.used, offline.block.data() + 2 * (offline.used + count), lr);
+		offline.used += count;
+		lr += 2 * count;
+		frames -= count;
+	}
+}
+
+void Sound::render_to_wav(std::string const &filename, float seconds) {
+	std::vector< float > data(2 * size_t(std::max(0.0f, seconds) * AUDIO_RATE), 0.0f);
+	render(data.data(), uint32_t(data.size() / 2));
+	save_wav(filename, data, 2, AUDIO_RATE);
+}
 
 void Sound::lock() {
 	if (device) SDL_LockAudioDevice(device);
@@ -99,110 +729,297 @@ void Sound::unlock() {
 	if (device) SDL_UnlockAudioDevice(device);
 }
 
-std::shared_ptr< Sound::PlayingSample > Sound::play(Sample const &sample, float play_volume, float pan) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, play_volume, pan, false);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+Sound::PlayingSample Sound::play(Sample const &sample, float play_volume, float pan, int priority, Bus bus) {
+	return start_voice(sample, false, play_volume, pan, glm::vec3(std::numeric_limits< float >::quiet_NaN()), std::numeric_limits< float >::quiet_NaN(), priority, bus);
 }
 
-std::shared_ptr< Sound::PlayingSample > Sound::play_3D(Sample const &sample, float play_volume, glm::vec3 const &position, float half_volume_radius) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, play_volume, position, half_volume_radius, false);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+Sound::PlayingSample Sound::play_3D(Sample const &sample, float play_volume, glm::vec3 const &position, float half_volume_radius, int priority, Bus bus) {
+	return start_voice(sample, false, play_volume, std::numeric_limits< float >::quiet_NaN(), position, half_volume_radius, priority, bus);
 }
 
-std::shared_ptr< Sound::PlayingSample > Sound::loop(Sample const &sample, float play_volume, float pan) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, play_volume, pan, true);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+Sound::PlayingSample Sound::loop(Sample const &sample, float play_volume, float pan, int priority, Bus bus) {
+	return start_voice(sample, true, play_volume, pan, glm::vec3(std::numeric_limits< float >::quiet_NaN()), std::numeric_limits< float >::quiet_NaN(), priority, bus);
 }
 
 
 
-std::shared_ptr< Sound::PlayingSample > Sound::loop_3D(Sample const &sample, float play_volume, glm::vec3 const &position, float half_volume_radius) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, play_volume, position, half_volume_radius, true);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+Sound::PlayingSample Sound::loop_3D(Sample const &sample, float play_volume, glm::vec3 const &position, float half_volume_radius, int priority, Bus bus) {
+	return start_voice(sample, true, play_volume, std::numeric_limits< float >::quiet_NaN(), position, half_volume_radius, priority, bus);
 }
 
+Sound::PlayingSample Sound::play_at(uint64_t time, Sample const &sample, float play_volume, float pan, int priority, Bus bus) {
+	return start_voice(sample, false, play_volume, pan, glm::vec3(std::numeric_limits< float >::quiet_NaN()), std::numeric_limits< float >::quiet_NaN(), priority, bus, time);
+}
 
-void Sound::stop_all_samples() {
-	lock();
-	for (auto &s : playing_samples) {
-		s->stop();
+Sound::PlayingSample Sound::play_3D_at(uint64_t time, Sample const &sample, float play_volume, glm::vec3 const &position, float half_volume_radius, int priority, Bus bus) {
+	return start_voice(sample, false, play_volume, std::numeric_limits< float >::quiet_NaN(), position, half_volume_radius, priority, bus, time);
+}
+
+Sound::PlayingSample Sound::loop_at(uint64_t time, Sample const &sample, float play_volume, float pan, int priority, Bus bus) {
+	return start_voice(sample, true, play_volume, pan, glm::vec3(std::numeric_limits< float >::quiet_NaN()), std::numeric_limits< float >::quiet_NaN(), priority, bus, time);
+}
+
+Sound::PlayingSample Sound::loop_3D_at(uint64_t time, Sample const &sample, float play_volume, glm::vec3 const &position, float half_volume_radius, int priority, Bus bus) {
+	return start_voice(sample, true, play_volume, std::numeric_limits< float >::quiet_NaN(), position, half_volume_radius, priority, bus, time);
+}
+
+uint64_t Sound::audio_clock() {
+	return mix_clock.load(std::memory_order_acquire);
+}
+
+uint64_t Sound::playback_clock() {
+	if (device == 0) {
+		//offline: frames handed out by render() so far:
+		return mix_clock.load(std::memory_order_acquire) - (offline.size - offline.used);
 	}
+
+	//read a consistent (frame, time) pair:
+	uint64_t frame;
+	int64_t ns;
+	uint32_t before, after;
+	do {
+		before = last_block.sequence.load(std::memory_order_acquire);
+		frame = last_block.frame.load(std::memory_order_relaxed);
+		ns = last_block.ns.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		after = last_block.sequence.load(std::memory_order_relaxed);
+	} while ((before & 1) || before != after);
+
+	//the block that started at 'frame' will be heard 'output_latency' frames later; playback advances in real time since then:
+	int64_t now = std::chrono::duration_cast< std::chrono::nanoseconds >(std::chrono::steady_clock::now().time_since_epoch()).count();
+	int64_t elapsed = std::min< int64_t >(mix_samples, std::max< int64_t >(0, (now - ns) * AUDIO_RATE / 1000000000));
+	int64_t heard = int64_t(frame) - int64_t(output_latency) + elapsed;
+	return uint64_t(std::max< int64_t >(0, heard));
+}
+
+void Sound::set_voice_budget(uint32_t real_voices) {
+	voice_budget.store(real_voices, std::memory_order_relaxed);
+}
+
+void Sound::set_audibility_threshold(float gain) {
+	audibility_threshold.store(gain, std::memory_order_relaxed);
+}
+
+void Sound::set_interpolation(Interpolation interpolation_) {
+	interpolation.store(interpolation_, std::memory_order_relaxed);
+}
+
+void Sound::set_sample_memory_budget(size_t bytes, size_t pin_bytes) {
+	sample_memory.budget = bytes;
+	sample_memory.pin_bytes = pin_bytes;
+	sample_memory.warned = false;
+	if (bytes != 0) {
+		reclaim_voices();
+		fit_sample_budget(nullptr);
+	}
+}
+
+size_t Sound::get_sample_memory_used() {
+	return sample_memory.used;
+}
+
+Sound::Stats Sound::get_stats() {
+	Stats ret;
+	ret.deadline = float(deadline_ns(mix_samples) * 1.0e-9);
+	ret.callbacks = stats.callbacks.load(std::memory_order_relaxed);
+	ret.deadline_misses = stats.deadline_misses.load(std::memory_order_relaxed);
+	ret.late_callbacks = stats.late_callbacks.load(std::memory_order_relaxed);
+	for (uint32_t b = 0; b < Stats::HISTOGRAM_BINS; ++b) {
+		ret.histogram[b] = stats.histogram[b].load(std::memory_order_relaxed);
+	}
+	if (ret.callbacks != 0) {
+		ret.mean_duration = float(double(stats.total_ns.load(std::memory_order_relaxed)) * 1.0e-9 / double(ret.callbacks));
+	}
+	ret.max_duration = float(double(stats.max_ns.load(std::memory_order_relaxed)) * 1.0e-9);
+	ret.active_voices = stats.active_voices.load(std::memory_order_relaxed);
+	ret.virtual_voices = stats.virtual_voices.load(std::memory_order_relaxed);
+	ret.max_active_voices = stats.max_active_voices.load(std::memory_order_relaxed);
+	ret.max_real_voices = stats.max_real_voices.load(std::memory_order_relaxed);
+	ret.peak_l = stats.peak_l.load(std::memory_order_relaxed);
+	ret.peak_r = stats.peak_r.load(std::memory_order_relaxed);
+	if (device != 0) {
+		ret.device_rate = output.rate;
+		ret.device_frames = output.frames;
+	}
+	if (ret.callbacks != 0) {
+		ret.mean_resample_duration = float(double(stats.resample_ns.load(std::memory_order_relaxed)) * 1.0e-9 / double(ret.callbacks));
+	}
+	ret.max_resample_duration = float(double(stats.max_resample_ns.load(std::memory_order_relaxed)) * 1.0e-9);
+	return ret;
+}
+
+void Sound::reset_stats() {
+	Command command;
+	command.type = Command::ResetStats;
+	enqueue(std::move(command));
+}
+
+void Sound::set_stats_file(std::string const &filename) {
+	stats_file = filename;
+}
+
+void Sound::write_stats(std::ostream &to, Stats const &s) {
+	auto to_db = [](float gain) {
+		return (gain > 0.0f ? 20.0f * std::log10(gain) : -std::numeric_limits< float >::infinity());
+	};
+	auto old_flags = to.flags();
+	auto old_precision = to.precision();
+
+	to << std::fixed << std::setprecision(3);
+	to << "Audio mixing statistics:\n";
+	to << "  blocks mixed: " << s.callbacks << " (deadline " << s.deadline * 1000.0f << " ms per block)\n";
+	to << "  mix time: mean " << s.mean_duration * 1000.0f << " ms, max " << s.max_duration * 1000.0f << " ms\n";
+	to << "  deadline misses: " << s.deadline_misses << "\n";
+	to << "  late callbacks (likely underruns): " << s.late_callbacks << "\n";
+	if (s.device_rate != 0) {
+		to << "  device: " << s.device_rate << " Hz, " << s.device_frames << " frame buffer";
+		if (s.device_rate != uint32_t(AUDIO_RATE)) {
+			to << "; resampling from " << AUDIO_RATE << " Hz takes mean " << s.mean_resample_duration * 1000.0f << " ms, max " << s.max_resample_duration * 1000.0f << " ms per block";
+		}
+		to << "\n";
+	}
+	to << "  voices: " << s.active_voices << " active (" << s.virtual_voices << " virtual) in last block; max "
+	   << s.max_active_voices << " active, " << s.max_real_voices << " real\n";
+	to << std::setprecision(1);
+	to << "  peak level: L " << to_db(s.peak_l) << " dB, R " << to_db(s.peak_r) << " dB" << (std::max(s.peak_l, s.peak_r) > 1.0f ? " (clipping!)" : "") << "\n";
+	to << std::setprecision(2);
+	to << "  mix time histogram (% of deadline):\n";
+	for (uint32_t b = 0; b < Stats::HISTOGRAM_BINS; ++b) {
+		if (s.histogram[b] == 0) continue;
+		to << "    ";
+		if (b == 0) to << std::setw(6) << "...";
+		else to << std::setw(6) << 100.0f * Stats::histogram_bin_start(b);
+		to << " - ";
+		if (b + 1 == Stats::HISTOGRAM_BINS) to << std::setw(6) << "...";
+		else to << std::setw(6) << 100.0f * Stats::histogram_bin_start(b + 1);
+		to << "%: " << s.histogram[b] << "\n";
+	}
+	to.flush();
+
+	to.flags(old_flags);
+	to.precision(old_precision);
+}
+
+void Sound::set_bus_volume(Bus bus, float new_volume, float ramp) {
+	if (bus >= BUS_COUNT) throw std::runtime_error("Bus " + std::to_string(bus) + " doesn't exist.");
+	Command command;
+	command.type = Command::SetBusVolume;
+	command.bus = bus;
+	command.value = new_volume;
+	command.ramp = ramp;
+	enqueue(std::move(command));
+}
+
+void Sound::set_bus_send(Bus bus, Bus to, float level, float ramp) {
+	if (to >= BUS_COUNT) throw std::runtime_error("Bus " + std::to_string(to) + " doesn't exist.");
+	if (to <= bus) throw std::runtime_error("Bus " + std::to_string(bus) + " can only send to later buses (not to bus " + std::to_string(to) + ").");
+	Command command;
+	command.type = Command::SetBusSend;
+	command.bus = bus;
+	command.send_to = to;
+	command.value = level;
+	command.ramp = ramp;
+	enqueue(std::move(command));
+}
+
+void Sound::add_bus_effect(Bus bus, Effect *effect) {
+	if (bus >= BUS_COUNT) throw std::runtime_error("Bus " + std::to_string(bus) + " doesn't exist.");
+	assert(effect);
+	auto &chain = buses[bus];
+	if (chain.effect_count == MAX_BUS_EFFECTS) {
+		throw std::runtime_error("Bus " + std::to_string(bus) + " already has " + std::to_string(MAX_BUS_EFFECTS) + " effects.");
+	}
+	lock();
+	chain.effects[chain.effect_count++] = effect;
 	unlock();
 }
 
-void Sound::set_volume(float new_volume, float ramp) {
+void Sound::remove_bus_effect(Bus bus, Effect *effect) {
+	if (bus >= BUS_COUNT) throw std::runtime_error("Bus " + std::to_string(bus) + " doesn't exist.");
+	auto &chain = buses[bus];
 	lock();
-	volume.set(new_volume, ramp);
+	auto end = std::remove(chain.effects.begin(), chain.effects.begin() + chain.effect_count, effect);
+	chain.effect_count = uint32_t(end - chain.effects.begin());
 	unlock();
 }
 
+void Sound::stop_all_samples() {
+	Command command;
+	command.type = Command::StopAll;
+	enqueue(std::move(command));
+}
+
+void Sound::set_volume(float new_volume, float ramp) {
+	Command command;
+	command.type = Command::SetGlobalVolume;
+	command.value = new_volume;
+	command.ramp = ramp;
+	enqueue(std::move(command));
+}
+
 //------------------
+//(the mode checks -- e.g., 'ignore if not in 2D mode' -- happen when the command is applied)
 
-void Sound::PlayingSample::set_volume(float new_volume, float ramp) {
-	Sound::lock();
-	if (!stopping) {
-		volume.set(new_volume, ramp);
-	}
-	Sound::unlock();
+void Sound::PlayingSample::set_volume(float new_volume, float ramp) const {
+	Command command;
+	command.value = new_volume;
+	command.ramp = ramp;
+	enqueue(Command::SetVolume, *this, std::move(command));
 }
 
-void Sound::PlayingSample::set_pan(float new_pan, float ramp) {
-	if (!(pan.value == pan.value)) return; //ignore if not in '2D' mode
-	Sound::lock();
-	pan.set(new_pan, ramp);
-	Sound::unlock();
+void Sound::PlayingSample::set_pan(float new_pan, float ramp) const {
+	Command command;
+	command.value = new_pan;
+	command.ramp = ramp;
+	enqueue(Command::SetPan, *this, std::move(command));
 }
 
-void Sound::PlayingSample::set_position(glm::vec3 const &new_position, float ramp) {
-	if (pan.value == pan.value) return; //ignore if not in '3D' mode
-	Sound::lock();
-	position.set(new_position, ramp);
-	Sound::unlock();
+void Sound::PlayingSample::set_position(glm::vec3 const &new_position, float ramp) const {
+	Command command;
+	command.position = new_position;
+	command.ramp = ramp;
+	enqueue(Command::SetPosition, *this, std::move(command));
 }
 
-void Sound::PlayingSample::set_half_volume_radius(float new_radius, float ramp) {
-	if (pan.value == pan.value) return; //ignore if not in '3D' mode
-	Sound::lock();
-	half_volume_radius.set(new_radius, ramp);
-	Sound::unlock();
+void Sound::PlayingSample::set_half_volume_radius(float new_radius, float ramp) const {
+	Command command;
+	command.value = new_radius;
+	command.ramp = ramp;
+	enqueue(Command::SetHalfVolumeRadius, *this, std::move(command));
 }
 
-void Sound::PlayingSample::stop(float ramp) {
-	Sound::lock();
-	if (!(stopping || stopped)) {
-		stopping = true;
-		volume.target = 0.0f;
-		volume.ramp = ramp;
-	} else {
-		volume.ramp = std::min(volume.ramp, ramp);
-	}
-	Sound::unlock();
+void Sound::PlayingSample::set_rate(float new_rate, float ramp) const {
+	Command command;
+	command.value = std::max(MIN_PLAYBACK_RATE, std::min(MAX_PLAYBACK_RATE, new_rate));
+	command.ramp = ramp;
+	enqueue(Command::SetRate, *this, std::move(command));
+}
+
+void Sound::PlayingSample::stop(float ramp) const {
+	Command command;
+	command.ramp = ramp;
+	enqueue(Command::Stop, *this, std::move(command));
+}
+
+bool Sound::PlayingSample::stopped() const {
+	if (generation == 0) return true;
+	return voice_generations[index].load(std::memory_order_acquire) != generation;
 }
 
 //------------------
 
 void Sound::Listener::set_position_right(glm::vec3 const &new_position, glm::vec3 const &new_right, float ramp) {
-	Sound::lock();
-	position.set(new_position, ramp);
+	Command command;
+	command.type = Command::SetListener;
+	command.position = new_position;
 	//some extra code to make sure right is always a unit vector:
 	if (new_right == glm::vec3(0.0f)) {
-		right.set(glm::vec3(1.0f, 0.0f, 0.0f), ramp);
+		command.right = glm::vec3(1.0f, 0.0f, 0.0f);
 	} else {
-		right.set(glm::normalize(new_right), ramp);
+		command.right = glm::normalize(new_right);
 	}
-	Sound::unlock();
+	command.ramp = ramp;
+	enqueue(std::move(command));
 }
 
 //------------------------ internals --------------------------------
@@ -219,66 +1036,33 @@ inline void compute_pan_weights(float pan, float *left, float *right) {
 	*right = std::sin(ang);
 }
 
-//helper: 3D audio panning
-void compute_pan_from_listener_and_position(
-	glm::vec3 const &listener_position,
-	glm::vec3 const &listener_right,
-	glm::vec3 const &source_position,
-	float source_half_radius,
-	float *left, float *right
-	) {
-	glm::vec3 to = source_position - listener_position;
-	float distance = glm::length(to);
-	//start by panning based on direction.
-	//note that for a LR fade to sound uniform, sound power (squared magnitude) should remain constant.
-	if (distance == 0.0f) {
-		*left = *right = std::sqrt(2.0f);
-	} else {
-		//amt ranges from -1 (most left) to 1 (most right):
-		float amt = glm::dot(listener_right, to) / distance;
-		//turn into an angle from 0.0f (most left) to pi/2 (most right):
-		float ang = 0.5f * 3.1415926f * (0.5f * (amt + 1.0f));
-		*left = std::cos(ang);
-		*right = std::sin(ang);
-
-		//squared distance attenuation is realistic if there are no walls,
-		// but I'm going to use linear because it's sounds better to me.
-		// (feel free to change it, of course)
-		//want att = 0.5f at distance == half_volume_radius
-		float att = 1.0f / (1.0f + (distance / source_half_radius));
-		*left *= att;
-		*right *= att;
-	}
-}
-
-//helper: ramp updates...
-constexpr float const RAMP_STEP = float(MIX_SAMPLES) / float(AUDIO_RATE);
+//helper: ramp updates, by 'step' seconds (the length of one block)...
 
 //helper: ...for single values:
-void step_value_ramp(Sound::Ramp< float > &ramp) {
-	if (ramp.ramp < RAMP_STEP) {
+void step_value_ramp(Sound::Ramp< float > &ramp, float step) {
+	if (ramp.ramp < step) {
 		ramp.value = ramp.target;
 		ramp.ramp = 0.0f;
 	} else {
-		ramp.value += (RAMP_STEP / ramp.ramp) * (ramp.target - ramp.value);
-		ramp.ramp -= RAMP_STEP;
+		ramp.value += (step / ramp.ramp) * (ramp.target - ramp.value);
+		ramp.ramp -= step;
 	}
 }
 
 //helper: ...for 3D positions:
-void step_position_ramp(Sound::Ramp< glm::vec3 > &ramp) {
-	if (ramp.ramp < RAMP_STEP) {
+void step_position_ramp(Sound::Ramp< glm::vec3 > &ramp, float step) {
+	if (ramp.ramp < step) {
 		ramp.value = ramp.target;
 		ramp.ramp = 0.0f;
 	} else {
-		ramp.value = glm::mix(ramp.value, ramp.target, RAMP_STEP / ramp.ramp);
-		ramp.ramp -= RAMP_STEP;
+		ramp.value = glm::mix(ramp.value, ramp.target, step / ramp.ramp);
+		ramp.ramp -= step;
 	}
 }
 
 //helper: ...for 3D directions:
-void step_direction_ramp(Sound::Ramp< glm::vec3 > &ramp) {
-	if (ramp.ramp < RAMP_STEP) {
+void step_direction_ramp(Sound::Ramp< glm::vec3 > &ramp, float step) {
+	if (ramp.ramp < step) {
 		ramp.value = ramp.target;
 		ramp.ramp = 0.0f;
 	} else {
@@ -302,137 +1086,669 @@ void step_direction_ramp(Sound::Ramp< glm::vec3 > &ramp) {
 		float angle = std::acos(glm::clamp(glm::dot(ramp.value, ramp.target), -1.0f, 1.0f));
 
 		//figure out new target value by moving angle toward target:
-		angle *= (ramp.ramp - RAMP_STEP) / ramp.ramp;
+		angle *= (ramp.ramp - step) / ramp.ramp;
 
 		ramp.value = ramp.target * std::cos(angle) + perp * std::sin(angle);
-		ramp.ramp -= RAMP_STEP;
+		ramp.ramp -= step;
+	}
+}
+
+
+//helper: stop a voice (fade out over 'ramp' seconds):
+void stop_voice(Voice &voice, float ramp) {
+	if (!voice.stopping) {
+		voice.stopping = true;
+		voice.volume.target = 0.0f;
+		voice.volume.ramp = ramp;
+	} else {
+		voice.volume.ramp = std::min(voice.volume.ramp, ramp);
+	}
+}
+
+//Apply all commands queued by the game thread:
+// (called from the audio thread, or from the game thread when holding the audio lock)
+void apply_commands() {
+	Command command;
+	while (commands.pop(&command)) {
+		if (command.type == Command::StopAll) {
+			for (uint32_t a = 0; a < active_voice_count; ++a) {
+				stop_voice(voices[active_voices[a]], 1.0f / 60.0f);
+			}
+			continue;
+		} else if (command.type == Command::SetGlobalVolume) {
+			Sound::volume.set(command.value, command.ramp);
+			continue;
+		} else if (command.type == Command::SetListener) {
+			Sound::listener.position.set(command.position, command.ramp);
+			Sound::listener.right.set(command.right, command.ramp);
+			continue;
+		} else if (command.type == Command::SetBusVolume) {
+			assert(command.bus < Sound::BUS_COUNT);
+			buses[command.bus].volume.set(command.value, command.ramp);
+			continue;
+		} else if (command.type == Command::SetBusSend) {
+			assert(command.bus < command.send_to && command.send_to < Sound::BUS_COUNT);
+			buses[command.bus].sends[command.send_to].set(command.value, command.ramp);
+			continue;
+		} else if (command.type == Command::ResetStats) {
+			for (auto &bin : stats.histogram) bin.store(0, std::memory_order_relaxed);
+			stats.callbacks.store(0, std::memory_order_relaxed);
+			stats.deadline_misses.store(0, std::memory_order_relaxed);
+			stats.late_callbacks.store(0, std::memory_order_relaxed);
+			stats.total_ns.store(0, std::memory_order_relaxed);
+			stats.max_ns.store(0, std::memory_order_relaxed);
+			stats.max_active_voices.store(0, std::memory_order_relaxed);
+			stats.max_real_voices.store(0, std::memory_order_relaxed);
+			stats.peak_l.store(0.0f, std::memory_order_relaxed);
+			stats.peak_r.store(0.0f, std::memory_order_relaxed);
+			stats.resample_ns.store(0, std::memory_order_relaxed);
+			stats.max_resample_ns.store(0, std::memory_order_relaxed);
+			continue;
+		}
+
+		assert(command.index < MAX_VOICES);
+		Voice &voice = voices[command.index];
+
+		if (command.type == Command::Play) {
+			assert(voice.generation == 0 && "Voice slot should be free.");
+			voice.data = command.data;
+			voice.storage = command.storage;
+			voice.size = command.size;
+			voice.stream = command.stream;
+			voice.i = 0;
+			voice.frac = 0.0f;
+			voice.start_time = command.start_time;
+			voice.generation = command.generation;
+			voice.loop = command.loop;
+			voice.stopping = false;
+			voice.priority = command.priority;
+			voice.bus = command.bus;
+			voice.mixing = Voice::New;
+			voice.volume = Sound::Ramp< float >(command.value);
+			voice.rate = Sound::Ramp< float >(1.0f);
+			voice.pan = Sound::Ramp< float >(command.pan);
+			voice.position = Sound::Ramp< glm::vec3 >(command.position);
+			voice.half_volume_radius = Sound::Ramp< float >(command.half_volume_radius);
+			assert(active_voice_count < MAX_VOICES);
+			active_voices[active_voice_count++] = command.index;
+			continue;
+		}
+
+		if (voice.generation != command.generation) continue; //stale handle; voice has already finished
+
+		switch (command.type) {
+			case Command::SetVolume:
+				if (!voice.stopping) {
+					voice.volume.set(command.value, command.ramp);
+				}
+				break;
+			case Command::SetPan:
+				if (!(voice.pan.value == voice.pan.value)) break; //ignore if not in '2D' mode
+				voice.pan.set(command.value, command.ramp);
+				break;
+			case Command::SetPosition:
+				if (voice.pan.value == voice.pan.value) break; //ignore if not in '3D' mode
+				voice.position.set(command.position, command.ramp);
+				break;
+			case Command::SetHalfVolumeRadius:
+				if (voice.pan.value == voice.pan.value) break; //ignore if not in '3D' mode
+				voice.half_volume_radius.set(command.value, command.ramp);
+				break;
+			case Command::SetRate:
+				if (voice.stream) break; //streams always play at their own rate
+				voice.rate.set(command.value, command.ramp);
+				break;
+			case Command::Stop:
+				stop_voice(voice, command.ramp);
+				break;
+			default:
+				assert(0 && "Unhandled command type.");
+				break;
+		}
+	}
+}
+
+//scale from 16-bit integer samples to [-1,1]:
+constexpr float const INT16_SCALE = 1.0f / 32767.0f;
+
+//decoded ADPCM for the current span (a span covers at most MAX_MIX_SAMPLES values, which may straddle one extra block):
+static std::array< int16_t, MAX_MIX_SAMPLES + ADPCM_BLOCK_SAMPLES > adpcm_scratch;
+
+//variable-rate playback reads a block's worth of data values (as floats, plus a few neighbors for interpolation) into here...
+static std::array< float, uint32_t(MAX_MIX_SAMPLES * Sound::MAX_PLAYBACK_RATE) + 8 > rate_source;
+//...and interpolates them to output frames in here:
+static std::array< float, MAX_MIX_SAMPLES > rate_output;
+
+//helper: how a voice's playhead moves over one 'frames'-long block with rate going linearly from 'rate_start' to 'rate_end':
+// from frame 'offset' on, it moves '*rate' values per frame (growing by '*drate' each frame), for '*advance' values in all.
+// (the interpolate_ kernels place each frame's playhead the same way)
+void playhead_motion(uint32_t frames, uint32_t offset, float rate_start, float rate_end, float *rate, float *drate, double *advance) {
+	*drate = (rate_end - rate_start) / float(frames);
+	*rate = rate_start + *drate * float(offset);
+	uint32_t n = frames - offset;
+	*advance = double(n) * double(*rate) + double(*drate) * (0.5 * double(n) * double(n - 1));
+}
+
+//helper: move a voice's playhead forward by 'advance' data values (wrapping if looping):
+// returns true if the voice ran off the end of its data.
+bool move_playhead(Voice &voice, double advance) {
+	double position = double(voice.i) + double(voice.frac) + advance;
+	double whole = std::floor(position);
+	voice.frac = std::min(float(position - whole), std::nextafter(1.0f, 0.0f));
+	if (whole >= double(voice.size)) {
+		if (!voice.loop) {
+			voice.i = voice.size;
+			voice.frac = 0.0f;
+			return true;
+		}
+		whole = std::fmod(whole, double(voice.size));
 	}
+	voice.i = uint32_t(whole);
+	return false;
 }
 
+//helper: copy 'count' of a voice's data values, starting at index 'first' (possibly negative), to 'out' as floats:
+// (indices outside the data wrap around for looping voices and are silent otherwise)
+void read_source(Voice const &voice, int64_t first, uint32_t count, float *out) {
+	int64_t size = voice.size;
+	for (uint32_t done = 0; done < count; /* later */) {
+		int64_t j = first + done;
+		if (voice.loop) {
+			j %= size;
+			if (j < 0) j += size;
+		} else if (j < 0 || j >= size) {
+			uint32_t span = (j < 0 ? uint32_t(std::min< int64_t >(-j, count - done)) : count - done);
+			std::fill(out + done, out + done + span, 0.0f);
+			done += span;
+			continue;
+		}
+		uint32_t span = uint32_t(std::min< int64_t >(size - j, count - done));
+		if (voice.storage == Sound::Sample::Int16) {
+			int16_t const *data = reinterpret_cast< int16_t const * >(voice.data) + j;
+			for (uint32_t k = 0; k < span; ++k) out[done + k] = float(data[k]) * INT16_SCALE;
+		} else if (voice.storage == Sound::Sample::ADPCM) {
+			//decode one block at a time (the span may be longer than adpcm_scratch):
+			uint8_t const *data = reinterpret_cast< uint8_t const * >(voice.data);
+			for (uint32_t k = 0; k < span; /* later */) {
+				uint32_t b = uint32_t(j + k) / ADPCM_BLOCK_SAMPLES;
+				uint32_t skip = uint32_t(j + k) - b * ADPCM_BLOCK_SAMPLES;
+				uint32_t run = std::min(span - k, ADPCM_BLOCK_SAMPLES - skip);
+				decode_adpcm_block(data + size_t(b) * ADPCM_BLOCK_BYTES, adpcm_scratch.data());
+				for (uint32_t x = 0; x < run; ++x) out[done + k + x] = float(adpcm_scratch[skip + x]) * INT16_SCALE;
+				k += run;
+			}
+		} else {
+			float const *data = reinterpret_cast< float const * >(voice.data) + j;
+			std::copy(data, data + span, out + done);
+		}
+		done += span;
+	}
+}
+
+//helper: mix one block of a voice into 'buffer', with gains moving linearly from 'start' to 'end':
+// (the block is 'frames' frames long; voices scheduled to start partway through the block begin at frame 'offset')
+// playback rate moves linearly from 'rate_start' to 'rate_end' over the block.
+// returns true if the voice reached the end of its data.
+bool mix_voice(Voice &voice, LR *buffer, uint32_t frames, LR const &start, LR const &end, uint32_t offset, float rate_start, float rate_end) {
+	assert(offset < frames);
+
+	//figure out a step to add at each sample so that pan will move smoothly from start to end:
+	LR pan_step;
+	pan_step.l = (end.l - start.l) / frames;
+	pan_step.r = (end.r - start.r) / frames;
+	LR pan;
+	pan.l = start.l + pan_step.l * float(offset);
+	pan.r = start.r + pan_step.r * float(offset);
+
+	if (voice.stream) {
+		//mix whatever the decoder has ready; spans end at the end of the buffer or the end of the ring:
+		for (uint32_t mixed = offset; mixed < frames; /* later */) {
+			uint32_t ready = 0;
+			float const *data = voice.stream->peek(voice.generation, &ready);
+			if (ready == 0) {
+				//decoder fell behind (leave the rest of this block silent) or stream is over (or was taken over by a newer voice):
+				if (!voice.stream->finished(voice.generation)) voice.stream->underruns.fetch_add(1, std::memory_order_relaxed);
+				break;
+			}
+			uint32_t span = std::min(frames - mixed, ready);
+
+			mix_mono_to_stereo(data, span, &buffer[mixed].l, pan.l, pan.r, pan_step.l, pan_step.r);
+			voice.stream->consume(voice.generation, span);
+
+			pan.l += pan_step.l * float(span);
+			pan.r += pan_step.r * float(span);
+			mixed += span;
+		}
+		return voice.stream->finished(voice.generation);
+	}
+
+	assert(voice.i < voice.size);
+
+	if (voice.frac != 0.0f || rate_start != 1.0f || rate_end != 1.0f) {
+		//variable rate: read the data values this block covers, interpolate them to output frames, and mix those:
+		float rate, drate;
+		double advance;
+		playhead_motion(frames, offset, rate_start, rate_end, &rate, &drate, &advance);
+		uint32_t count = frames - offset;
+		//(the playhead starts one value into rate_source; interpolation may also read the value before it and two past the end)
+		uint32_t needed = uint32_t(double(voice.frac) + advance) + 5;
+		assert(needed <= rate_source.size());
+		read_source(voice, int64_t(voice.i) - 1, needed, rate_source.data());
+		if (interpolation.load(std::memory_order_relaxed) == Sound::Linear) {
+			interpolate_linear(rate_source.data(), count, 1.0f + voice.frac, rate, drate, rate_output.data());
+		} else {
+			interpolate_cubic(rate_source.data(), count, 1.0f + voice.frac, rate, drate, rate_output.data());
+		}
+		mix_mono_to_stereo(rate_output.data(), count, &buffer[offset].l, pan.l, pan.r, pan_step.l, pan_step.r);
+		return move_playhead(voice, advance);
+	}
+
+	//mix whole spans of the sample at once; spans end at the end of the buffer or the end of the sample data:
+	for (uint32_t mixed = offset; mixed < frames; /* later */) {
+		uint32_t span = std::min(frames - mixed, voice.size - voice.i);
+
+		if (voice.storage == Sound::Sample::Int16) {
+			int16_t const *data = reinterpret_cast< int16_t const * >(voice.data);
+			mix_int16_mono_to_stereo(data + voice.i, span, &buffer[mixed].l,
+				pan.l * INT16_SCALE, pan.r * INT16_SCALE, pan_step.l * INT16_SCALE, pan_step.r * INT16_SCALE);
+		} else if (voice.storage == Sound::Sample::ADPCM) {
+			//decode the blocks that overlap the span, then mix the decoded values:
+			uint8_t const *data = reinterpret_cast< uint8_t const * >(voice.data);
+			uint32_t first = voice.i / ADPCM_BLOCK_SAMPLES;
+			uint32_t last = (voice.i + span - 1) / ADPCM_BLOCK_SAMPLES;
+			for (uint32_t b = first; b <= last; ++b) {
+				decode_adpcm_block(data + size_t(b) * ADPCM_BLOCK_BYTES, adpcm_scratch.data() + (b - first) * ADPCM_BLOCK_SAMPLES);
+			}
+			mix_int16_mono_to_stereo(adpcm_scratch.data() + (voice.i - first * ADPCM_BLOCK_SAMPLES), span, &buffer[mixed].l,
+				pan.l * INT16_SCALE, pan.r * INT16_SCALE, pan_step.l * INT16_SCALE, pan_step.r * INT16_SCALE);
+		} else {
+			float const *data = reinterpret_cast< float const * >(voice.data);
+			mix_mono_to_stereo(data + voice.i, span, &buffer[mixed].l, pan.l, pan.r, pan_step.l, pan_step.r);
+		}
+
+		//update pan values:
+		pan.l += pan_step.l * float(span);
+		pan.r += pan_step.r * float(span);
+
+		//update position in sample:
+		mixed += span;
+		voice.i += span;
+		if (voice.i == voice.size) {
+			if (voice.loop) {
+				voice.i = 0;
+			} else {
+				break;
+			}
+		}
+	}
+	return voice.i >= voice.size;
+}
+
+//helper: advance a virtual voice by one 'frames'-long block (less 'offset' frames before it starts) without mixing it:
+// returns true if the voice reached the end of its data.
+bool advance_voice(Voice &voice, uint32_t frames, uint32_t offset, float rate_start, float rate_end) {
+	assert(offset < frames);
+	if (voice.stream) {
+		//keep reading so the stream stays in step with the rest of the mix:
+		for (uint32_t skipped = offset; skipped < frames; /* later */) {
+			uint32_t ready = 0;
+			voice.stream->peek(voice.generation, &ready);
+			if (ready == 0) break;
+			uint32_t span = std::min(frames - skipped, ready);
+			voice.stream->consume(voice.generation, span);
+			skipped += span;
+		}
+		return voice.stream->finished(voice.generation);
+	}
+
+	if (voice.frac != 0.0f || rate_start != 1.0f || rate_end != 1.0f) {
+		float rate, drate;
+		double advance;
+		playhead_motion(frames, offset, rate_start, rate_end, &rate, &drate, &advance);
+		return move_playhead(voice, advance);
+	}
+
+	voice.i += frames - offset;
+	if (voice.i >= voice.size) {
+		if (voice.loop) {
+			voice.i %= voice.size;
+		} else {
+			voice.i = voice.size;
+			return true;
+		}
+	}
+	return false;
+}
 
 //The audio callback -- invoked by SDL when it needs more sound to play:
 void mix_audio(void *, Uint8 *buffer_, int len) {
 	assert(buffer_); //should always have some audio buffer
 
-	struct LR {
-		float l;
-		float r;
-	};
-	static_assert(sizeof(LR) == 8, "Sample is packed");
-	assert(len == MIX_SAMPLES * sizeof(LR)); //should always have the expected number of samples
+	//block size follows the device's buffer size:
+	assert(len > 0 && len % sizeof(LR) == 0 && len <= int(MAX_MIX_SAMPLES * sizeof(LR)));
+	uint32_t frames = uint32_t(len / sizeof(LR));
 	LR *buffer = reinterpret_cast< LR * >(buffer_);
 
+	//seconds of audio in this block (the step used for all parameter ramps):
+	float ramp_step = float(frames) / float(AUDIO_RATE);
+
+	auto start_time = std::chrono::steady_clock::now();
+
+	//audio clock times covered by this block:
+	uint64_t block_begin = mix_clock.load(std::memory_order_relaxed);
+	uint64_t block_end = block_begin + frames;
+
+	//note the block's start for playback_clock():
+	last_block.sequence.fetch_add(1, std::memory_order_relaxed); //(now odd)
+	std::atomic_thread_fence(std::memory_order_release);
+	last_block.frame.store(block_begin, std::memory_order_relaxed);
+	last_block.ns.store(std::chrono::duration_cast< std::chrono::nanoseconds >(start_time.time_since_epoch()).count(), std::memory_order_relaxed);
+	last_block.sequence.fetch_add(1, std::memory_order_release); //(even again)
+
 	//zero the output buffer:
-	for (uint32_t s = 0; s < MIX_SAMPLES; ++s) {
+	for (uint32_t s = 0; s < frames; ++s) {
 		buffer[s].l = 0.0f;
 		buffer[s].r = 0.0f;
 	}
 
+	//pick up any changes made by the game thread since the last callback:
+	apply_commands();
+
 	//update global values:
 	float start_volume = Sound::volume.value;
 	glm::vec3 start_position =  Sound::listener.position.value;
 	glm::vec3 start_right =  Sound::listener.right.value;
 
-	step_value_ramp(Sound::volume);
-	step_position_ramp( Sound::listener.position);
-	step_direction_ramp( Sound::listener.right);
+	step_value_ramp(Sound::volume, ramp_step);
+	step_position_ramp( Sound::listener.position, ramp_step);
+	step_direction_ramp( Sound::listener.right, ramp_step);
 
 	float end_volume = Sound::volume.value;
 	glm::vec3 end_position =  Sound::listener.position.value;
 	glm::vec3 end_right =  Sound::listener.right.value;
 
-	//add audio from each playing sample into the buffer:
-	for (auto si = playing_samples.begin(); si != playing_samples.end(); /* later */) {
-		Sound::PlayingSample &playing_sample = **si; //much more convenient than writing ** everywhere.
-
-		//Figure out sample panning/volume at start...
-		LR start_pan;
-		if (!(playing_sample.pan.value == playing_sample.pan.value)) {
-			//3D panning
-			compute_pan_from_listener_and_position(
-				start_position, start_right,
-				playing_sample.position.value,
-				playing_sample.half_volume_radius.value,
-				&start_pan.l, &start_pan.r);
-
-			step_position_ramp(playing_sample.position);
-			step_value_ramp(playing_sample.half_volume_radius);
-		} else {
-			//2D panning
-			compute_pan_weights(playing_sample.pan.value, &start_pan.l, &start_pan.r);
+	//bus gains (including global volume) and send gains (bus volume times send level) at the start and end of the mix period:
+	std::array< LR, Sound::BUS_COUNT > bus_gains; //(l == start, r == end)
+	std::array< std::array< LR, Sound::BUS_COUNT >, Sound::BUS_COUNT > send_gains; //[from][to], (l == start, r == end)
+	for (uint32_t b = 0; b < Sound::BUS_COUNT; ++b) {
+		SubmixBus &bus = buses[b];
+		float start_bus = bus.volume.value;
+		step_value_ramp(bus.volume, ramp_step);
+		float end_bus = bus.volume.value;
+		bus_gains[b] = LR{ start_volume * start_bus, end_volume * end_bus };
+		for (uint32_t t = b + 1; t < Sound::BUS_COUNT; ++t) {
+			send_gains[b][t].l = start_bus * bus.sends[t].value;
+			step_value_ramp(bus.sends[t], ramp_step);
+			send_gains[b][t].r = end_bus * bus.sends[t].value;
+		}
+		bus.mixed = false;
+	}
 
-			step_value_ramp(playing_sample.pan);
+	//figure out each voice's panning/volume at the start and end of the mix period:
+	// (2D voices directly; 3D voices are gathered into pan_batches and panned all at once, below)
+	Pan3DBatch &start_batch = pan_batches[0];
+	Pan3DBatch &end_batch = pan_batches[1];
+	uint32_t batch_count = 0;
+	for (uint32_t a = 0; a < active_voice_count; ++a) {
+		Voice &voice = voices[active_voices[a]];
+		VoiceMix &mix = voice_mixes[a];
+
+		mix.rate_start = voice.rate.value;
+		step_value_ramp(voice.rate, ramp_step);
+		mix.rate_end = voice.rate.value;
+
+		if (!(voice.pan.value == voice.pan.value)) {
+			//3D panning: record position/radius/volume at start and end of the mix period
+			start_batch.set(batch_count, voice.position.value, voice.half_volume_radius.value, voice.volume.value);
+
+			step_position_ramp(voice.position, ramp_step);
+			step_value_ramp(voice.half_volume_radius, ramp_step);
+			step_value_ramp(voice.volume, ramp_step);
+
+			end_batch.set(batch_count, voice.position.value, voice.half_volume_radius.value, voice.volume.value);
+			batch_voices[batch_count] = a;
+			++batch_count;
+			continue;
 		}
-		start_pan.l *= start_volume * playing_sample.volume.value;
-		start_pan.r *= start_volume * playing_sample.volume.value;
 
-		step_value_ramp(playing_sample.volume);
+		//2D panning:
+		compute_pan_weights(voice.pan.value, &mix.start.l, &mix.start.r);
+		mix.start.l *= voice.volume.value;
+		mix.start.r *= voice.volume.value;
 
-		//..and end of the mix period:
-		LR end_pan;
-		if (!(playing_sample.pan.value == playing_sample.pan.value)) {
-			//3D panning
-			compute_pan_from_listener_and_position(
-				end_position, end_right,
-				playing_sample.position.value,
-				playing_sample.half_volume_radius.value,
-				&end_pan.l, &end_pan.r);
-		} else {
-			//2D panning
-			compute_pan_weights(playing_sample.pan.value, &end_pan.l, &end_pan.r);
-		}
+		step_value_ramp(voice.pan, ramp_step);
+		step_value_ramp(voice.volume, ramp_step);
 
-		end_pan.l *= end_volume * playing_sample.volume.value;
-		end_pan.r *= end_volume * playing_sample.volume.value;
+		compute_pan_weights(voice.pan.value, &mix.end.l, &mix.end.r);
+		mix.end.l *= voice.volume.value;
+		mix.end.r *= voice.volume.value;
+	}
 
-		//figure out a step to add at each sample so that pan will move smoothly from start to end:
-		LR pan = start_pan;
-		LR pan_step;
-		pan_step.l = (end_pan.l - start_pan.l) / MIX_SAMPLES;
-		pan_step.r = (end_pan.r - start_pan.r) / MIX_SAMPLES;
+	if (batch_count) {
+		start_batch.pan(batch_count, start_position, start_right);
+		end_batch.pan(batch_count, end_position, end_right);
+		for (uint32_t b = 0; b < batch_count; ++b) {
+			VoiceMix &mix = voice_mixes[batch_voices[b]];
+			mix.start = LR{ start_batch.left[b], start_batch.right[b] };
+			mix.end = LR{ end_batch.left[b], end_batch.right[b] };
+		}
+	}
 
-		assert(playing_sample.i < playing_sample.data.size());
+	for (uint32_t a = 0; a < active_voice_count; ++a) {
+		VoiceMix &mix = voice_mixes[a];
+		//(bus and global volume are applied when the bus is mixed, but they count toward audibility)
+		LR const &bus_gain = bus_gains[voices[active_voices[a]].bus];
+		mix.loudness = std::max(
+			bus_gain.l * std::max(mix.start.l, mix.start.r),
+			bus_gain.r * std::max(mix.end.l, mix.end.r)
+		);
+		mix.real = false;
+	}
 
-		for (uint32_t i = 0; i < MIX_SAMPLES; ++i) {
-			//mix one sample based on current pan values:
-			buffer[i].l += pan.l * playing_sample.data[playing_sample.i];
-			buffer[i].r += pan.r * playing_sample.data[playing_sample.i];
+	{ //decide which voices are real (mixed) and which are virtual (only advanced):
+		float threshold = audibility_threshold.load(std::memory_order_relaxed);
+		uint32_t budget = voice_budget.load(std::memory_order_relaxed);
 
-			//update position in sample:
-			playing_sample.i += 1;
-			if (playing_sample.i == playing_sample.data.size()) {
-				if (playing_sample.loop) {
-					playing_sample.i = 0;
-				} else {
-					break;
-				}
+		//only audible voices that have started are candidates:
+		uint32_t candidate_count = 0;
+		for (uint32_t a = 0; a < active_voice_count; ++a) {
+			if (voice_mixes[a].loudness >= threshold && voices[active_voices[a]].start_time < block_end) {
+				mix_candidates[candidate_count++] = a;
 			}
+		}
 
-			//update pan values:
-			pan.l += pan_step.l;
-			pan.r += pan_step.r;
+		//if there are too many, keep the highest-priority (then loudest) ones:
+		if (candidate_count > budget) {
+			std::nth_element(mix_candidates.begin(), mix_candidates.begin() + budget, mix_candidates.begin() + candidate_count,
+				[](uint32_t a, uint32_t b) {
+					int pa = voices[active_voices[a]].priority;
+					int pb = voices[active_voices[b]].priority;
+					if (pa != pb) return pa > pb;
+					return voice_mixes[a].loudness > voice_mixes[b].loudness;
+				});
+			candidate_count = budget;
 		}
 
-		if (playing_sample.i >= playing_sample.data.size()
-		 || (playing_sample.stopping && playing_sample.volume.value == 0.0f)) { //sample has finished
-		 	playing_sample.stopped = true;
-			//erase from list:
-			auto old = si;
-			++si;
-			playing_samples.erase(old);
+		for (uint32_t c = 0; c < candidate_count; ++c) {
+			voice_mixes[mix_candidates[c]].real = true;
+		}
+		virtual_voice_count = active_voice_count - candidate_count;
+	}
+
+	//add audio from each real voice into the buffer (and advance virtual voices):
+	for (uint32_t a = 0; a < active_voice_count; /* later */) {
+		uint32_t index = active_voices[a];
+		Voice &voice = voices[index];
+		VoiceMix const &mix = voice_mixes[a];
+
+		//voices scheduled to start in a later block just wait:
+		// (unless stopped while waiting, in which case they are removed below)
+		bool waiting = (voice.start_time >= block_end);
+		//voices scheduled to start in this block start on their exact frame:
+		uint32_t offset = (voice.start_time > block_begin && !waiting ? uint32_t(voice.start_time - block_begin) : 0);
+
+		//voices are mixed into their bus (cleared when the first voice is mixed into it):
+		SubmixBus &bus = buses[voice.bus];
+		if (!waiting && (mix.real || voice.mixing == Voice::Real) && !bus.mixed) {
+			std::fill(bus.mix.begin(), bus.mix.begin() + frames, LR{0.0f, 0.0f});
+			bus.mixed = true;
+		}
+		LR *bus_buffer = bus.mix.data();
+
+		bool finished;
+		if (waiting) {
+			finished = false;
+		} else if (mix.real) {
+			//fade in voices that are coming back from being virtual:
+			finished = mix_voice(voice, bus_buffer, frames, (voice.mixing == Voice::Virtual ? LR{0.0f, 0.0f} : mix.start), mix.end, offset, mix.rate_start, mix.rate_end);
+			voice.mixing = Voice::Real;
+		} else if (voice.mixing == Voice::Real && mix.loudness >= audibility_threshold.load(std::memory_order_relaxed)) {
+			//voice was bumped by the budget while still audible; fade it out rather than cutting it off:
+			finished = mix_voice(voice, bus_buffer, frames, mix.start, LR{0.0f, 0.0f}, offset, mix.rate_start, mix.rate_end);
+			voice.mixing = Voice::Virtual;
 		} else {
-			++si;
+			finished = advance_voice(voice, frames, offset, mix.rate_start, mix.rate_end);
+			voice.mixing = Voice::Virtual;
+		}
+
+		if (finished
+		 || (voice.stopping && voice.volume.value == 0.0f)) { //sample has finished
+			//let go of stream (if any) so it can be played again:
+			if (voice.stream) {
+				voice.stream->release(voice.generation);
+				voice.stream = nullptr;
+			}
+			//free the voice (handles to it are now stale):
+			voice.generation = 0;
+			voice_generations[index].store(0, std::memory_order_release);
+			bool pushed = finished_voices.push(index);
+			assert(pushed && "Finished voice queue can hold every voice.");
+			(void)pushed;
+			//remove from active list (order doesn't matter):
+			--active_voice_count;
+			active_voices[a] = active_voices[active_voice_count];
+			voice_mixes[a] = voice_mixes[active_voice_count];
+		} else {
+			++a;
 		}
 	}
 
+	//run each bus's effects on its mix, pass it on to any later buses it sends to, and add it into the output:
+	for (uint32_t b = 0; b < Sound::BUS_COUNT; ++b) {
+		SubmixBus &bus = buses[b];
+		if (!bus.mixed) {
+			if (bus.effect_count == 0) continue; //silent, and nothing to process
+			//effects may still have output (e.g., a reverb tail), so give them a silent block:
+			std::fill(bus.mix.begin(), bus.mix.begin() + frames, LR{0.0f, 0.0f});
+		}
+		for (uint32_t e = 0; e < bus.effect_count; ++e) {
+			bus.effects[e]->process(&bus.mix[0].l, frames);
+		}
+		for (uint32_t t = b + 1; t < Sound::BUS_COUNT; ++t) {
+			LR const &send = send_gains[b][t];
+			if (send.l == 0.0f && send.r == 0.0f) continue;
+			SubmixBus &to = buses[t];
+			if (!to.mixed) {
+				std::fill(to.mix.begin(), to.mix.begin() + frames, LR{0.0f, 0.0f});
+				to.mixed = true;
+			}
+			mix_stereo(&bus.mix[0].l, frames, &to.mix[0].l, send.l, (send.r - send.l) / frames);
+		}
+		mix_stereo(&bus.mix[0].l, frames, &buffer[0].l, bus_gains[b].l, (bus_gains[b].r - bus_gains[b].l) / frames);
+	}
+
 	/*//DEBUG: report output power:
 	float max_power = 0.0f;
-	for (uint32_t s = 0; s < MIX_SAMPLES; ++s) {
+	for (uint32_t s = 0; s < frames; ++s) {
 		max_power = std::max(max_power, (buffer[s].l * buffer[s].l + buffer[s].r * buffer[s].r));
 	}
-	std::cout << "Max Power: " << std::sqrt(max_power) << "; playing samples: " << playing_samples.size() << std::endl; //DEBUG
+	std::cout << "Max Power: " << std::sqrt(max_power) << "; playing voices: " << active_voice_count << " (" << virtual_voice_count << " virtual)" << std::endl; //DEBUG
 	*/
 
+	//advance the audio clock:
+	mix_clock.store(block_end, std::memory_order_release);
+
+	{ //update statistics:
+		LR peak{0.0f, 0.0f};
+		for (uint32_t s = 0; s < frames; ++s) {
+			peak.l = std::max(peak.l, std::abs(buffer[s].l));
+			peak.r = std::max(peak.r, std::abs(buffer[s].r));
+		}
+		stats_max(stats.peak_l, peak.l);
+		stats_max(stats.peak_r, peak.r);
+
+		stats.active_voices.store(active_voice_count, std::memory_order_relaxed);
+		stats.virtual_voices.store(virtual_voice_count, std::memory_order_relaxed);
+		stats_max(stats.max_active_voices, active_voice_count);
+		stats_max(stats.max_real_voices, active_voice_count - std::min(active_voice_count, virtual_voice_count));
+
+		auto end_time = std::chrono::steady_clock::now();
+		uint64_t ns = uint64_t(std::chrono::duration_cast< std::chrono::nanoseconds >(end_time - start_time).count());
+		stats_add(stats.callbacks, uint64_t(1));
+		stats_add(stats.total_ns, ns);
+		stats_max(stats.max_ns, ns);
+		double deadline = deadline_ns(frames);
+		bool missed = (ns > deadline);
+		if (missed) stats_add(stats.deadline_misses, uint64_t(1));
+		//(inverse of Stats::histogram_bin_start)
+		double bin_f = 2.0 * std::log2(std::max(1.0, double(ns)) / deadline) + double(Sound::Stats::HISTOGRAM_BINS - 2);
+		uint32_t bin = uint32_t(std::max(0.0, std::min(double(Sound::Stats::HISTOGRAM_BINS - 1), std::floor(bin_f))));
+		stats_add(stats.histogram[bin], uint64_t(1));
+
+		if (missed) note_miss(block_begin);
+	}
+
 }
 
+//The device callback -- hands the device mixed audio, converted to the device's rate (if needed):
+void output_audio(void *, Uint8 *stream, int len) {
+	assert(stream && len >= 0 && len % sizeof(LR) == 0);
+	uint32_t frames = uint32_t(len / sizeof(LR));
+	LR *out = reinterpret_cast< LR * >(stream);
+
+	{ //callbacks should arrive about one device buffer apart; a much longer gap means the device probably ran dry:
+		auto now = std::chrono::steady_clock::now();
+		double period = 1.0e9 * double(output.frames) / double(output.rate);
+		if (stats.have_last_start && std::chrono::duration< double, std::nano >(now - stats.last_start).count() > 1.5 * period) {
+			stats_add(stats.late_callbacks, uint64_t(1));
+			note_miss(mix_clock.load(std::memory_order_relaxed));
+		}
+		stats.last_start = now;
+		stats.have_last_start = true;
+	}
+
+	//usual case -- the device wants exactly one block at the mixing rate, so mix right into its buffer:
+	if (!output.left && frames == mix_samples && output.used == output.size) {
+		mix_audio(nullptr, stream, len);
+		return;
+	}
 
+	while (frames > 0) {
+		if (output.used == output.size) {
+			//mix another block and convert it:
+			mix_audio(nullptr, reinterpret_cast< Uint8 * >(output.block.data()), int(mix_samples * sizeof(LR)));
+			if (!output.left) {
+				std::copy(output.block.begin(), output.block.begin() + mix_samples, output.pending.begin());
+				output.size = mix_samples;
+			} else {
+				auto start_time = std::chrono::steady_clock::now();
+				//(the two resamplers see the same number of inputs, so they always produce the same number of outputs)
+				for (uint32_t s = 0; s < mix_samples; ++s) output.channel[s] = output.block[s].l;
+				output.size = output.left->process(output.channel.data(), mix_samples, output.converted.data());
+				for (uint32_t s = 0; s < output.size; ++s) output.pending[s].l = output.converted[s];
+				for (uint32_t s = 0; s < mix_samples; ++s) output.channel[s] = output.block[s].r;
+				output.right->process(output.channel.data(), mix_samples, output.converted.data());
+				for (uint32_t s = 0; s < output.size; ++s) output.pending[s].r = output.converted[s];
+				uint64_t ns = uint64_t(std::chrono::duration_cast< std::chrono::nanoseconds >(std::chrono::steady_clock::now() - start_time).count());
+				stats_add(stats.resample_ns, ns);
+				stats_max(stats.max_resample_ns, ns);
+			}
+			output.used = 0;
+		}
+		uint32_t count = std::min(frames, output.size - output.used);
+		std::copy(output.pending.begin() + output.used, output.pending.begin() + output.used + count, out);
+		output.used += count;
+		out += count;
+		frames -= count;
+	}
+}
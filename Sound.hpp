@@ -2,27 +2,71 @@
 
 #include <glm/glm.hpp>
 
+#include <array>
 #include <memory>
 #include <vector>
 #include <string>
 #include <cmath>
+#include <cstdint>
+#include <limits>
+#include <iosfwd>
 
 //Game audio system. Simplified from f18-base3.
-//Uses 48kHz sampling rate.
+//Uses 48kHz sampling rate (Sound::AUDIO_RATE).
+
+struct OpusStream;
 
 namespace Sound {
 
 //Sample objects hold mono (one-channel) audio.
 struct Sample {
+	//How sample data is kept:
+	enum Storage {
+		Decoded, //decode the whole file when loading (fine for most sound effects)
+		Int16, //...and keep it as 16-bit integers (half the memory of Decoded)
+		ADPCM, //...and keep it as 4-bit ADPCM (under a seventh of the memory; lossy, but fine for most sound effects)
+		Streamed, //decode on a background thread while playing (good for long music tracks; '.opus' only)
+	};
+
 	//Load from a '.wav' or '.opus' file.
 	//  will warn and convert if sound is not already 48kHz mono:
-	Sample(std::string const &filename);
+	Sample(std::string const &filename, Storage storage = Decoded);
 	
-	//Directly supply an audio buffer:
-	Sample(std::vector< float > const &data);
+	//Directly supply an audio buffer (storage can be Decoded, Int16, or ADPCM):
+	Sample(std::vector< float > const &data, Storage storage = Decoded);
+
+	//Refer to audio data owned by something else (e.g., a SampleBank); it must outlive the sample:
+	Sample(float const *view, uint32_t view_size);
+
+	~Sample();
 
 	//sample data is stored as 48kHz, mono, floating-point:
 	std::vector< float > data;
+
+	//...or, for samples that refer to data owned elsewhere, data is empty and this is set:
+	float const *view = nullptr;
+	uint32_t view_size = 0;
+
+	//...or, for Int16 and ADPCM samples, data is empty and one of these is set (see sample_encoding.hpp):
+	std::vector< int16_t > data_int16;
+	std::vector< uint8_t > data_adpcm;
+	uint32_t adpcm_count = 0; //number of samples in data_adpcm (the last block may be partly padding)
+
+	//...or, for streamed samples, data is empty and this is set:
+	// (a streamed sample is played by one voice at a time -- playing it again restarts it, and the voice that was playing it goes silent)
+	std::unique_ptr< OpusStream > stream;
+
+	//...or it was loaded while a sample memory budget was set (see set_sample_memory_budget), in which case data is
+	// empty and the decoded sample is kept in here, when resident (sample_count() is 0 until it is first played):
+	struct Managed;
+	std::unique_ptr< Managed > managed;
+
+	Storage storage = Decoded;
+
+	//float sample data, wherever it is stored (nullptr for Int16 and ADPCM samples, and for budgeted samples that aren't resident):
+	float const *samples() const;
+	//number of samples, however they are stored:
+	uint32_t sample_count() const;
 };
 
 //Ramp<> manages values that should be smoothly interpolated
@@ -48,44 +92,61 @@ struct Ramp {
 	float ramp = 0.0f;
 };
 
-// 'PlayingSample' objects book-keep samples that are currently playing:
+// 'PlayingSample' handles refer to samples that are currently playing.
+// They are small values (copy them freely); once the sample finishes playing, the handle
+//  goes stale and calls made through it are quietly ignored.
 struct PlayingSample {
-	//change the panning or volume of a playing sample (and do proper locking);
+	//change the panning or volume of a playing sample (the change is queued for the audio thread);
 	// value will change over 'ramp' seconds to avoid creating audible artifacts:
-	void set_volume(float new_volume, float ramp = 1.0f / 60.0f);
+	void set_volume(float new_volume, float ramp = 1.0f / 60.0f) const;
 	//set the panning of a sample (use only on samples in "2D" mode; no effect on "3D" samples):
-	void set_pan(float new_pan, float ramp = 1.0f / 60.0f);
+	void set_pan(float new_pan, float ramp = 1.0f / 60.0f) const;
 	//set the position of a sample (use only on samples in "3D" mode; no effect on "2D" samples):
-	void set_position(glm::vec3 const &new_position, float ramp = 1.0f / 60.0f);
+	void set_position(glm::vec3 const &new_position, float ramp = 1.0f / 60.0f) const;
 	//set the half-volume radius (use only on "3D" playing sounds):
-	void set_half_volume_radius(float new_radius, float ramp = 1.0f / 60.0f);
+	void set_half_volume_radius(float new_radius, float ramp = 1.0f / 60.0f) const;
+	//set the playback rate -- 1.0 is normal, 2.0 is twice as fast (an octave higher), 0.5 half as fast (an octave lower):
+	// (clamped to [MIN_PLAYBACK_RATE, MAX_PLAYBACK_RATE]; no effect on streamed samples)
+	// to start a sample at some other pitch, call this with 'ramp' 0.0 right after play().
+	void set_rate(float new_rate, float ramp = 1.0f / 60.0f) const;
 
 	//'stop' will fade sample out over 'ramp' seconds and then remove it from the active samples:
-	void stop(float ramp = 1.0f / 60.0f);
+	void stop(float ramp = 1.0f / 60.0f) const;
+
+	//was playback stopped (either by running out of sample, or by stop())?
+	// (also true for handles that never referred to anything, e.g., when all voices were busy)
+	bool stopped() const;
 
 	//internals:
-	//NOTE: PlayingSample is used in a separate thread; so setting these values directly
-	// may result in bad results. Instead, use the functions above, which perform locking!
-	std::vector< float > const &data; //reference to sample data being played
-	uint32_t i = 0; //next data value to read
-	bool loop = false; //should playback loop after data runs out?
-	bool stopping = false; //is playing stopping?
-	bool stopped = false; //was playback stopped (either by running out of sample, or by stop())?
-
-	Ramp< float > volume = Ramp< float >(1.0f);
-
-	//2D playback panning control: ('NaN' if sound played in 3D mode)
-	Ramp< float > pan = Ramp< float >(std::numeric_limits< float >::quiet_NaN());
-
-	//3D playback panning control: ('NaN' if sound played in 2D mode)
-	Ramp< glm::vec3 > position = Ramp< glm::vec3 >(std::numeric_limits< float >::quiet_NaN());
-	Ramp< float > half_volume_radius = std::numeric_limits< float >::quiet_NaN();
-
-	PlayingSample(Sample const &sample_, float volume_, float pan_, bool loop_)
-		: data(sample_.data), loop(loop_), volume(volume_), pan(pan_) { }
-	PlayingSample(Sample const &sample_, float volume_, glm::vec3 const &position_, float half_volume_radius_, bool loop_)
-		: data(sample_.data), loop(loop_), volume(volume_), position(position_), half_volume_radius(half_volume_radius_) { }
+	uint32_t index = 0; //slot in the audio system's voice pool
+	uint32_t generation = 0; //which use of that slot this handle refers to (0 == none)
+};
+
+//The audio system mixes at most this many samples at once;
+// 'play' and friends return a stopped handle if all voices are in use:
+constexpr uint32_t const MAX_PLAYING_SAMPLES = 256;
+
+//range of PlayingSample::set_rate:
+constexpr float const MIN_PLAYBACK_RATE = 1.0f / 16.0f;
+constexpr float const MAX_PLAYBACK_RATE = 4.0f;
+
+//Submix buses: every playing sample is mixed into one bus. Each bus has its own volume and effect chain,
+// which are applied once per block to the bus's whole mix (so their cost doesn't grow with the number of samples playing):
+enum Bus : uint8_t {
+	SFX, //sound effects (the default)
+	Music,
+	UI,
+	Aux, //shared effects (e.g., reverb), usually fed by the other buses' sends (see set_bus_send)
 };
+constexpr uint32_t const BUS_COUNT = 4;
+
+//Effects process a bus's mix in place, one block at a time, on the audio thread:
+struct Effect {
+	virtual ~Effect() { }
+	//'lr' holds 'frames' interleaved stereo frames; process() must not allocate, lock, or otherwise block:
+	virtual void process(float *lr, uint32_t frames) = 0;
+};
+//(some ready-made effects are in SoundEffects.hpp)
 
 // ------- global functions -------
 
@@ -93,36 +154,166 @@ void init(); //call Sound::init() from main.cpp before using any member function
 
 void shutdown(); //call Sound::shutdown() from main.cpp to gracefully(-ish) exit
 
+//Output buffer size, in frames. Smaller buffers mean less delay between play() and hearing the sound,
+// but the mixer has to keep up with them (and does more work per frame): 1024 (the default) is about 21ms; 128 is under 3ms.
+// sizes are powers of two from MIN_BUFFER_FRAMES to MAX_BUFFER_FRAMES; changing the size briefly reopens the audio device.
+constexpr uint32_t const MIN_BUFFER_FRAMES = 128;
+constexpr uint32_t const MAX_BUFFER_FRAMES = 1024;
+void set_buffer_frames(uint32_t frames); //throws on invalid size
+uint32_t get_buffer_frames();
+//if enabled (the default), the buffer size doubles (in Sound::update()) whenever mixing repeatedly misses its deadline:
+void set_adaptive_buffer(bool enabled);
+
+void update(); //call Sound::update() once per frame from main.cpp (applies adaptive buffer changes)
+
+//Offline rendering -- runs the mixer without an audio device (e.g., for tools and benchmarks):
+void init_offline(); //call instead of Sound::init()
+//mix the next 'frames' frames of output into 'lr' (interleaved left/right), as if the device had played them:
+void render(float *lr, uint32_t frames);
+//render the next 'seconds' of output to a (48kHz, stereo, float) '.wav' file; throws on error:
+void render_to_wav(std::string const &filename, float seconds);
+
 //Call 'Sound::play' to play a sample once.
 //  if you hang on to the return value, you can change the panning, volume, or stop playback early.
-std::shared_ptr< PlayingSample > play(
+//  'priority' decides which sounds keep playing audibly when there are more than the voice budget (see below).
+//  'bus' picks the submix bus the sample is mixed into (see above).
+//  streamed samples only play on one voice at a time: playing (or looping) one that is already playing -- or still
+//  fading out after stop() -- restarts it on the new voice, and the old voice goes silent.
+PlayingSample play(
 	Sample const &sample,
 	float volume = 1.0f,
-	float pan = 0.0f //-1.0f == hard left, 1.0f == hard right
+	float pan = 0.0f, //-1.0f == hard left, 1.0f == hard right
+	int priority = 0, //higher == more important
+	Bus bus = SFX
 );
 //The play_3D version will play a sample in '3D' mode (that is, panning determined by listener position):
-std::shared_ptr< PlayingSample > play_3D(
+PlayingSample play_3D(
 	Sample const &sample,
 	float volume,
 	glm::vec3 const &position,
-	float half_volume_radius = std::numeric_limits< float >::infinity()
+	float half_volume_radius = std::numeric_limits< float >::infinity(),
+	int priority = 0,
+	Bus bus = SFX
 );
 
 //Call 'Sound::loop' to play a sample ~forever~.
 //  if you hang on to the return value, you can change the panning, volume, or stop playback.
-std::shared_ptr< PlayingSample > loop(
+PlayingSample loop(
 	Sample const &sample,
 	float volume = 1.0f,
-	float pan = 0.0f //-1.0f == hard left, 1.0f == hard right
+	float pan = 0.0f, //-1.0f == hard left, 1.0f == hard right
+	int priority = 0,
+	Bus bus = SFX
 );
 //The loop_3D version will loop a sample in '3D' mode (that is, panning determined by listener position):
-std::shared_ptr< PlayingSample > loop_3D(
+PlayingSample loop_3D(
 	Sample const &sample,
 	float volume,
 	glm::vec3 const &position,
-	float half_volume_radius = std::numeric_limits< float >::infinity()
+	float half_volume_radius = std::numeric_limits< float >::infinity(),
+	int priority = 0,
+	Bus bus = SFX
 );
 
+//set the volume of a bus (applied on top of the volumes of the samples playing on it):
+void set_bus_volume(Bus bus, float new_volume, float ramp = 1.0f / 60.0f);
+
+//set how much of a bus's output (after its effects and volume) is also sent to a later bus:
+// (e.g., set_bus_send(SFX, Aux, 0.3f) with a reverb on Aux gives sound effects a shared reverb)
+void set_bus_send(Bus bus, Bus to, float level, float ramp = 1.0f / 60.0f); //throws unless 'to' comes after 'bus'
+
+//Bus effect chains are applied in the order effects were added; an effect must stay alive until it is removed.
+// (these briefly take the audio lock; once they return, the audio thread is done with any removed effect)
+constexpr uint32_t const MAX_BUS_EFFECTS = 4;
+void add_bus_effect(Bus bus, Effect *effect); //throws if the bus's chain is full
+void remove_bus_effect(Bus bus, Effect *effect);
+
+//Scheduling -- for sounds that need to line up exactly (e.g., with a beat):
+//The audio clock counts frames of output (AUDIO_RATE per second) since the mixer started.
+constexpr uint32_t const AUDIO_RATE = 48000;
+
+//The next frame the mixer will produce; samples scheduled at or after this time start on exactly their frame:
+// (plain play() calls start at the next block the mixer produces, which can be up to a block later than this)
+uint64_t audio_clock();
+//Estimate of the frame being heard right now (audio_clock() minus output latency, advanced smoothly between blocks):
+// use this to keep visuals in step with scheduled sounds.
+uint64_t playback_clock();
+
+//Versions of the play/loop functions that start the sample at audio clock time 'time':
+// a 'time' that has already passed starts the sample as soon as possible (i.e., late, but whole).
+PlayingSample play_at(uint64_t time, Sample const &sample, float volume = 1.0f, float pan = 0.0f, int priority = 0, Bus bus = SFX);
+PlayingSample play_3D_at(uint64_t time, Sample const &sample, float volume, glm::vec3 const &position, float half_volume_radius = std::numeric_limits< float >::infinity(), int priority = 0, Bus bus = SFX);
+PlayingSample loop_at(uint64_t time, Sample const &sample, float volume = 1.0f, float pan = 0.0f, int priority = 0, Bus bus = SFX);
+PlayingSample loop_3D_at(uint64_t time, Sample const &sample, float volume, glm::vec3 const &position, float half_volume_radius = std::numeric_limits< float >::infinity(), int priority = 0, Bus bus = SFX);
+
+//Voice virtualization keeps mixing cost bounded:
+// each block, only voices at or above the audibility threshold are candidates for mixing, and at most
+// 'voice budget' of those (highest priority first, then loudest) are actually mixed.
+// The rest are "virtual": they keep advancing through their samples silently, and are
+// mixed again (with a short fade-in) as soon as they are selected.
+void set_voice_budget(uint32_t real_voices); //default: 64
+//gain (after volume, panning, and distance attenuation) below which a voice is virtual:
+void set_audibility_threshold(float gain); //default: 0.001 (-60dB)
+
+//How samples playing at rates other than 1.0 are read between their data values:
+enum Interpolation : uint8_t {
+	Linear, //cheapest; dulls high frequencies and adds some aliasing
+	Cubic, //Catmull-Rom spline; a little more expensive, noticeably cleaner (the default)
+};
+void set_interpolation(Interpolation interpolation);
+
+//Sample memory budget, for memory-constrained deployments:
+// samples loaded from files after this is set (except Streamed ones) aren't decoded until they are first played;
+// when decoding one goes over 'bytes', the least-recently-played samples with no voices playing are dropped
+// (and decoded again if played later -- usually a quick read from the decoded-audio cache, see pcm_cache.hpp).
+// Samples smaller than 'pin_bytes' stay decoded once decoded.
+// (set before loading samples; the default budget, 0, means no budget: samples decode when loaded and stay decoded)
+void set_sample_memory_budget(size_t bytes, size_t pin_bytes = 64 * 1024);
+size_t get_sample_memory_used(); //bytes of budgeted sample data currently decoded
+
+//Mixer statistics, gathered by the audio callback (without locking) to help tune voice budgets:
+struct Stats {
+	//time available to mix each block (the time the block takes to play), in seconds:
+	float deadline = 0.0f;
+
+	uint64_t callbacks = 0; //blocks mixed
+	uint64_t deadline_misses = 0; //blocks that took longer than the deadline to mix
+	uint64_t late_callbacks = 0; //device callbacks more than half a device buffer late -- likely underruns (not counted when rendering offline)
+
+	//block mixing times, binned by fraction of the deadline:
+	// bins are half an octave wide; bin b counts blocks that took from histogram_bin_start(b) up to
+	// histogram_bin_start(b+1) of the deadline (the first bin also counts anything faster; the last, anything slower):
+	static constexpr uint32_t HISTOGRAM_BINS = 24;
+	static float histogram_bin_start(uint32_t b) { return std::exp2(0.5f * (float(b) - float(HISTOGRAM_BINS - 2))); }
+	std::array< uint64_t, HISTOGRAM_BINS > histogram{};
+	float mean_duration = 0.0f; //seconds
+	float max_duration = 0.0f; //seconds
+
+	uint32_t active_voices = 0; //voices playing in the last block
+	uint32_t virtual_voices = 0; //...of which were virtual
+	uint32_t max_active_voices = 0;
+	uint32_t max_real_voices = 0;
+
+	//largest output values (after global volume, before clipping; > 1.0 means clipping):
+	float peak_l = 0.0f;
+	float peak_r = 0.0f;
+
+	//output device (zeros when there is no device, e.g., when rendering offline):
+	uint32_t device_rate = 0; //Hz (blocks are mixed at AUDIO_RATE and resampled to this if it's different)
+	uint32_t device_frames = 0; //device buffer size, in frames at device_rate
+	//time spent resampling mixed blocks for the device (not part of the mix time above):
+	float mean_resample_duration = 0.0f; //seconds per block
+	float max_resample_duration = 0.0f; //seconds
+};
+//get a copy of the current statistics (gathered since startup or the last reset_stats()):
+// fields are read one at a time, so counts can be off by a block from each other.
+Stats get_stats();
+void reset_stats(); //queued for the audio thread, like other commands
+//write statistics to a (text) file on Sound::shutdown() ("" to disable, which is the default):
+void set_stats_file(std::string const &filename);
+//write statistics in a human-readable form:
+void write_stats(std::ostream &to, Stats const &stats);
+
 //Listener controls the panning of "3D" samples (ones played using the "position" version of the play functions):
 struct Listener {
 	void set_position_right(glm::vec3 const &new_position, glm::vec3 const &new_right, float ramp = 1.0f / 60.0f);
@@ -141,8 +332,9 @@ void set_volume(float new_volume, float ramp = 1.0f / 60.0f);
 extern Ramp< float > volume;
 
 //the audio callback doesn't run between Sound::lock() and Sound::unlock()
-// the set_*/stop/play/... functions already use these helpers, so you shouldn't need
-// to call them unless your code is modifying values directly:
+// the set_*/stop/play/... functions don't need these helpers -- they pass commands to the audio
+// thread through a lock-free queue -- so you shouldn't need to call them unless your code is
+// modifying values directly:
 void lock();
 void unlock();
 
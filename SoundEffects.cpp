@@ -0,0 +1,142 @@
+#include "SoundEffects.hpp"
+#include "mix_kernels.hpp"
+#include "sample_encoding.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+
+//coefficient for a one-pole low-pass with the given cutoff:
+static float one_pole_coefficient(float cutoff) {
+	cutoff = std::max(0.0f, std::min(0.5f * float(Sound::AUDIO_RATE), cutoff));
+	return 1.0f - std::exp(-2.0f * 3.1415926f * cutoff / float(Sound::AUDIO_RATE));
+}
+
+Sound::LowPass::LowPass(float cutoff) : coefficient(one_pole_coefficient(cutoff)) {
+}
+
+void Sound::LowPass::set_cutoff(float cutoff) {
+	coefficient.store(one_pole_coefficient(cutoff), std::memory_order_relaxed);
+}
+
+void Sound::LowPass::process(float *lr, uint32_t frames) {
+	one_pole_stereo(lr, frames, coefficient.load(std::memory_order_relaxed), state);
+}
+
+//------------------------------------
+
+Sound::ConvolutionReverb::ConvolutionReverb(Sample const &impulse_response) : fft(2 * PARTITION) {
+	uint32_t const N = 2 * PARTITION;
+
+	//get the impulse response as floats, however it is stored:
+	std::vector< float > response;
+	if (impulse_response.storage == Sample::Streamed) {
+		throw std::runtime_error("A convolution reverb's impulse response can't be a streamed sample.");
+	} else if (impulse_response.managed) {
+		throw std::runtime_error("A convolution reverb's impulse response can't be a budgeted sample (load it with no sample memory budget set).");
+	} else if (impulse_response.storage == Sample::Int16) {
+		response.reserve(impulse_response.data_int16.size());
+		for (int16_t value : impulse_response.data_int16) {
+			response.emplace_back(value / 32767.0f);
+		}
+	} else if (impulse_response.storage == Sample::ADPCM) {
+		std::array< int16_t, ADPCM_BLOCK_SAMPLES > block;
+		for (uint32_t b = 0; b * ADPCM_BLOCK_BYTES < impulse_response.data_adpcm.size(); ++b) {
+			decode_adpcm_block(impulse_response.data_adpcm.data() + b * ADPCM_BLOCK_BYTES, block.data());
+			for (int16_t value : block) {
+				response.emplace_back(value / 32767.0f);
+			}
+		}
+		response.resize(impulse_response.adpcm_count);
+	} else {
+		response.assign(impulse_response.samples(), impulse_response.samples() + impulse_response.sample_count());
+	}
+
+	partitions = std::max(1u, uint32_t((response.size() + PARTITION - 1) / PARTITION));
+	if (partitions > MAX_PARTITIONS) {
+		std::cerr << "WARNING: convolution reverb impulse response is " << (response.size() / float(AUDIO_RATE)) << " seconds long; only using the first " << (MAX_PARTITIONS * PARTITION / float(AUDIO_RATE)) << " seconds." << std::endl;
+		partitions = MAX_PARTITIONS;
+	}
+	response.resize(partitions * PARTITION, 0.0f);
+
+	//transform each piece of the impulse response, zero-padded to 2 * PARTITION:
+	// (1 / N is folded in here, since the inverse FFT is unnormalized)
+	response_re.assign(partitions * N, 0.0f);
+	response_im.assign(partitions * N, 0.0f);
+	for (uint32_t p = 0; p < partitions; ++p) {
+		float *re = response_re.data() + p * N;
+		float *im = response_im.data() + p * N;
+		for (uint32_t i = 0; i < PARTITION; ++i) {
+			re[i] = response[p * PARTITION + i] / float(N);
+		}
+		fft.forward(re, im);
+	}
+
+	history_re.assign(partitions * N, 0.0f);
+	history_im.assign(partitions * N, 0.0f);
+	input_re.assign(N, 0.0f);
+	input_im.assign(N, 0.0f);
+	output_re.assign(PARTITION, 0.0f);
+	output_im.assign(PARTITION, 0.0f);
+	tail_re.assign(N, 0.0f);
+	tail_im.assign(N, 0.0f);
+	work_re.assign(N, 0.0f);
+	work_im.assign(N, 0.0f);
+}
+
+void Sound::ConvolutionReverb::process(float *lr, uint32_t frames) {
+	uint32_t const N = 2 * PARTITION;
+
+	for (uint32_t done = 0; done < frames; /* later */) {
+		//take in input (into the second half of the input window) and play out the current output partition:
+		uint32_t count = std::min(PARTITION - fill, frames - done);
+		for (uint32_t i = 0; i < count; ++i) {
+			input_re[PARTITION + fill + i] = lr[2 * (done + i) + 0];
+			input_im[PARTITION + fill + i] = lr[2 * (done + i) + 1];
+			lr[2 * (done + i) + 0] = output_re[fill + i];
+			lr[2 * (done + i) + 1] = output_im[fill + i];
+		}
+		fill += count;
+		done += count;
+
+		//keep pace accumulating the tail (piece k times the input partition from k partitions before the next one):
+		uint32_t tail_target = (partitions - 1) * fill / PARTITION;
+		for (; tail_done < tail_target; ++tail_done) {
+			uint32_t k = tail_done + 1;
+			uint32_t slot = (newest + partitions + 1 - k) % partitions;
+			complex_mac(history_re.data() + slot * N, history_im.data() + slot * N,
+				response_re.data() + k * N, response_im.data() + k * N,
+				N, tail_re.data(), tail_im.data());
+		}
+
+		if (fill < PARTITION) continue;
+
+		//a whole new partition of input has arrived; transform it (along with the previous one, for overlap-save):
+		newest = (newest + 1) % partitions;
+		float *spectrum_re = history_re.data() + newest * N;
+		float *spectrum_im = history_im.data() + newest * N;
+		std::copy(input_re.begin(), input_re.end(), spectrum_re);
+		std::copy(input_im.begin(), input_im.end(), spectrum_im);
+		fft.forward(spectrum_re, spectrum_im);
+
+		//output spectrum is the tail plus the new input times the first piece:
+		std::copy(tail_re.begin(), tail_re.end(), work_re.begin());
+		std::copy(tail_im.begin(), tail_im.end(), work_im.begin());
+		complex_mac(spectrum_re, spectrum_im, response_re.data(), response_im.data(), N, work_re.data(), work_im.data());
+		fft.inverse(work_re.data(), work_im.data());
+
+		//the second half of the (circular) convolution is free of wrap-around:
+		std::copy(work_re.begin() + PARTITION, work_re.end(), output_re.begin());
+		std::copy(work_im.begin() + PARTITION, work_im.end(), output_im.begin());
+
+		std::fill(tail_re.begin(), tail_re.end(), 0.0f);
+		std::fill(tail_im.begin(), tail_im.end(), 0.0f);
+		tail_done = 0;
+
+		std::copy(input_re.begin() + PARTITION, input_re.end(), input_re.begin());
+		std::copy(input_im.begin() + PARTITION, input_im.end(), input_im.begin());
+		fill = 0;
+	}
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "Sound.hpp"
+#include "FFT.hpp"
+
+#include <atomic>
+#include <vector>
+
+//Ready-made effects for Sound's submix buses (see Sound::add_bus_effect).
+//Parameters may be changed from the game thread while the effect is in use.
+
+namespace Sound {
+
+//One-pole low-pass filter (e.g., to muffle music behind a pause menu):
+struct LowPass : Effect {
+	LowPass(float cutoff = 20000.0f); //cutoff frequency, in Hz
+	void set_cutoff(float cutoff); //takes effect at the start of the next block
+
+	void process(float *lr, uint32_t frames) override;
+
+	//internals:
+	std::atomic< float > coefficient; //filter coefficient for the current cutoff
+	float state[2] = {0.0f, 0.0f}; //last output (left, right); only touched by the audio thread
+};
+
+//Convolution reverb: convolves the mix with an impulse response (a recording of how a space echoes a click).
+//Outputs only the reverberated sound, so it belongs on a send bus (e.g., Aux; see set_bus_send).
+//
+//Uses uniformly partitioned FFT convolution: the impulse response is cut into PARTITION-frame pieces, and each
+// PARTITION frames of input are transformed once and multiplied with every piece's spectrum. That work is spread
+// evenly over the blocks, so the cost per frame is fixed by the impulse response's length, whatever the block size.
+//The reverb is delayed by PARTITION frames (~11ms), which reads as a little pre-delay.
+struct ConvolutionReverb : Effect {
+	//the impulse response is mono (used for both channels) and is copied, so the sample need not outlive the reverb;
+	// impulse responses longer than MAX_PARTITIONS partitions are cut short (with a warning); throws if it is streamed or budgeted (see set_sample_memory_budget).
+	ConvolutionReverb(Sample const &impulse_response);
+
+	void process(float *lr, uint32_t frames) override;
+
+	static constexpr uint32_t const PARTITION = 512;
+	static constexpr uint32_t const MAX_PARTITIONS = 4 * AUDIO_RATE / PARTITION; //four seconds
+
+	//internals (only touched by the audio thread once the reverb is in use):
+	//left and right channels are the real and imaginary parts of one complex signal (the impulse response is real,
+	// so the channels don't mix), which lets each partition be done with one FFT of 2 * PARTITION points:
+	FFT fft;
+	uint32_t partitions = 0;
+	std::vector< float > response_re, response_im; //spectrum of each impulse response partition, one after another
+	std::vector< float > history_re, history_im; //spectra of the last 'partitions' input partitions (ring buffer)
+	uint32_t newest = 0; //history slot of the most recent input partition
+	std::vector< float > input_re, input_im; //last two partitions of input (left in re, right in im)
+	std::vector< float > output_re, output_im; //partition of output being played
+	uint32_t fill = 0; //frames of the current partition taken in (and played out) so far
+	std::vector< float > tail_re, tail_im; //older input partitions' contribution to the next output partition...
+	uint32_t tail_done = 0; //...accumulated for pieces 1 .. tail_done so far
+	std::vector< float > work_re, work_im; //FFT workspace
+};
+
+} //namespace Sound
@@ -0,0 +1,90 @@
+#include "WorkerPool.hpp"
+
+#include <algorithm>
+
+WorkerPool::WorkerPool(uint32_t workers) {
+	threads.reserve(workers);
+	for (uint32_t w = 0; w < workers; ++w) {
+		threads.emplace_back([this](){
+			uint64_t seen = 0;
+			while (true) {
+				std::function< void(uint32_t) > const *job_;
+				uint32_t count_;
+				{
+					std::unique_lock< std::mutex > lock(mutex);
+					wake.wait(lock, [&](){ return quit || posted != seen; });
+					if (quit) return;
+					seen = posted;
+					//(woke after run() was already done with these jobs:)
+					if (!job) continue;
+					job_ = job;
+					count_ = count;
+					++active;
+				}
+
+				uint32_t done = claim(*job_, count_);
+
+				{
+					std::unique_lock< std::mutex > lock(mutex);
+					--active;
+					remaining -= done;
+					if (remaining == 0 && active == 0) finished.notify_all();
+				}
+			}
+		});
+	}
+}
+
+WorkerPool::~WorkerPool() {
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		quit = true;
+	}
+	wake.notify_all();
+	for (auto &thread : threads) {
+		thread.join();
+	}
+}
+
+uint32_t WorkerPool::default_workers() {
+	return std::max(1U, std::thread::hardware_concurrency()) - 1;
+}
+
+uint32_t WorkerPool::claim(std::function< void(uint32_t) > const &job_, uint32_t count_) {
+	uint32_t done = 0;
+	while (true) {
+		uint32_t i = next.fetch_add(1, std::memory_order_relaxed);
+		if (i >= count_) break;
+		job_(i);
+		++done;
+	}
+	return done;
+}
+
+void WorkerPool::run(uint32_t count_, std::function< void(uint32_t) > const &job_) {
+	//not worth waking anyone:
+	if (threads.empty() || count_ <= 1) {
+		for (uint32_t i = 0; i < count_; ++i) {
+			job_(i);
+		}
+		return;
+	}
+
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		job = &job_;
+		count = count_;
+		next.store(0, std::memory_order_relaxed);
+		remaining = count_;
+		++posted;
+	}
+	wake.notify_all();
+
+	uint32_t done = claim(job_, count_);
+
+	//wait for the workers to finish (and to stop touching job_) before returning:
+	std::unique_lock< std::mutex > lock(mutex);
+	remaining -= done;
+	finished.wait(lock, [&](){ return remaining == 0 && active == 0; });
+	job = nullptr;
+}
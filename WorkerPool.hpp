@@ -0,0 +1,45 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//A few persistent threads for spreading data-parallel work ("parallel for") across cores.
+// Threads sleep between calls to run(), so a pool can be kept around (e.g., for per-frame work).
+struct WorkerPool {
+	//start 'workers' threads (the thread calling run() helps out too, so one fewer than the core count fills every core):
+	WorkerPool(uint32_t workers = default_workers());
+	~WorkerPool();
+	WorkerPool(WorkerPool const &) = delete;
+
+	//call job(i) for every i in [0, count), spread across the workers and the calling thread; returns once all calls are done:
+	// (only one thread may call run() at a time, and jobs must not call run() themselves)
+	void run(uint32_t count, std::function< void(uint32_t) > const &job);
+
+	//number of threads that run() uses, counting the caller:
+	uint32_t get_thread_count() const { return uint32_t(threads.size()) + 1; }
+
+	//one fewer than the number of cores:
+	static uint32_t default_workers();
+
+	//internals:
+	std::vector< std::thread > threads;
+
+	std::mutex mutex; //guards everything below except 'next'
+	std::condition_variable wake; //signaled when jobs (or quit) are posted
+	std::condition_variable finished; //signaled when the last job is done
+	std::function< void(uint32_t) > const *job = nullptr; //current jobs (nullptr between run() calls)
+	uint32_t count = 0;
+	std::atomic< uint32_t > next{0}; //next job index to claim
+	uint32_t remaining = 0; //jobs not yet finished
+	uint32_t active = 0; //workers that have picked up the current jobs and not yet reported back
+	uint64_t posted = 0; //incremented by each run(), so workers can tell new jobs from spurious wakeups
+	bool quit = false;
+
+	//claim and call jobs until none are left; returns how many were done:
+	uint32_t claim(std::function< void(uint32_t) > const &job, uint32_t count);
+};
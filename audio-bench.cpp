@@ -0,0 +1,180 @@
+//audio-bench: measures the cost of the Sound mixer without an audio device.
+//
+//Renders audio offline (faster than real time) with increasing numbers of voices and reports
+// the mixing cost per output frame, along with how many voices fit in the real-time budget.
+
+#include "Sound.hpp"
+#include "mix_kernels.hpp"
+
+#include <SDL.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+	//when compiled on windows, unhandled exceptions don't have their message printed, which can make debugging simple issues difficult.
+	try {
+#endif
+
+	//------------ command line ------------
+	float budget = 0.5f; //fraction of one core the mixer may use
+	float seconds = 2.0f; //length of audio to render per measurement
+	std::string wav_file = ""; //if set, write a short render of some 3D voices here
+	Sound::Sample::Storage storage = Sound::Sample::Decoded; //how test samples are kept in memory
+	uint32_t buffer_frames = Sound::MAX_BUFFER_FRAMES; //block size to mix
+
+	bool usage = false;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--budget" && i + 1 < argc) {
+			budget = std::stof(argv[++i]);
+		} else if (arg == "--seconds" && i + 1 < argc) {
+			seconds = std::stof(argv[++i]);
+		} else if (arg == "--wav" && i + 1 < argc) {
+			wav_file = argv[++i];
+		} else if (arg == "--storage" && i + 1 < argc) {
+			std::string name = argv[++i];
+			if (name == "float") storage = Sound::Sample::Decoded;
+			else if (name == "int16") storage = Sound::Sample::Int16;
+			else if (name == "adpcm") storage = Sound::Sample::ADPCM;
+			else usage = true;
+		} else if (arg == "--buffer" && i + 1 < argc) {
+			buffer_frames = uint32_t(std::stoul(argv[++i]));
+		} else {
+			usage = true;
+		}
+	}
+	if (usage || !(budget > 0.0f) || !(seconds > 0.0f)) {
+		std::cerr << "Usage:\n\t" << argv[0] << " [--budget <fraction of a core, default 0.5>] [--seconds <per test, default 2>] [--wav <out.wav>] [--storage float|int16|adpcm] [--buffer <frames, default 1024>]" << std::endl;
+		return 1;
+	}
+
+	Sound::init_offline();
+	Sound::set_buffer_frames(buffer_frames);
+	std::cout << "Mixing kernel: " << mix_kernel_name() << "; " << buffer_frames << " frame blocks." << std::endl;
+
+	//measure the cost of actually mixing every voice:
+	Sound::set_voice_budget(Sound::MAX_PLAYING_SAMPLES);
+
+	//------------ test samples ------------
+	//(synthetic, so the benchmark doesn't depend on any particular asset)
+	std::mt19937 mt(0x15466);
+	auto make_noise = [&mt](float length) {
+		std::uniform_real_distribution< float > dist(-0.1f, 0.1f);
+		std::vector< float > data(size_t(length * 48000.0f));
+		for (auto &d : data) d = dist(mt);
+		return data;
+	};
+	//one-shots are longer than each measurement so voices stay active throughout:
+	Sound::Sample one_shot(make_noise(seconds + 1.0f), storage);
+	//loops are shorter than each measurement so the loop point gets exercised:
+	Sound::Sample looping(make_noise(0.37f), storage);
+
+	Sound::listener.set_position_right(glm::vec3(0.0f), glm::vec3(1.0f, 0.0f, 0.0f), 0.0f);
+
+	//------------ measurements ------------
+	const uint32_t voice_counts[] = { 1, 2, 4, 8, 16, 32, 64, 128, Sound::MAX_PLAYING_SAMPLES };
+
+	struct Case {
+		const char *name;
+		bool three_d;
+		bool loop;
+	};
+	const Case cases[] = {
+		{ "2D one-shot", false, false },
+		{ "2D loop", false, true },
+		{ "3D one-shot", true, false },
+		{ "3D loop", true, true },
+	};
+
+	const uint32_t frames = uint32_t(seconds * 48000.0f);
+	std::vector< float > output(2 * size_t(frames));
+	const double ns_per_frame_budget = budget * 1.0e9 / 48000.0;
+
+	//start 'count' voices, render, and return ns spent per output frame:
+	auto measure = [&](Case const &c, uint32_t count) {
+		Sound::stop_all_samples();
+		Sound::render(output.data(), 2048); //let stop fades finish and free voices
+
+		std::uniform_real_distribution< float > unit(-1.0f, 1.0f);
+		for (uint32_t v = 0; v < count; ++v) {
+			Sound::Sample const &sample = (c.loop ? looping : one_shot);
+			if (c.three_d) {
+				glm::vec3 position(20.0f * unit(mt), 20.0f * unit(mt), 5.0f * unit(mt));
+				if (c.loop) Sound::loop_3D(sample, 1.0f, position, 10.0f);
+				else Sound::play_3D(sample, 1.0f, position, 10.0f);
+			} else {
+				if (c.loop) Sound::loop(sample, 1.0f, unit(mt));
+				else Sound::play(sample, 1.0f, unit(mt));
+			}
+		}
+
+		auto before = std::chrono::high_resolution_clock::now();
+		Sound::render(output.data(), frames);
+		auto after = std::chrono::high_resolution_clock::now();
+		return std::chrono::duration< double, std::nano >(after - before).count() / double(frames);
+	};
+
+	std::cout << std::fixed << std::setprecision(1);
+	std::cout << "Budget: " << budget * 100.0f << "% of a core (" << ns_per_frame_budget << " ns per output frame)." << std::endl;
+
+	for (auto const &c : cases) {
+		std::cout << "\n" << c.name << ":\n";
+		std::cout << "  voices   ns/frame   ns/frame/voice   x real time\n";
+		double first_ns = 0.0, last_ns = 0.0;
+		uint32_t first_count = 0, last_count = 0;
+		for (uint32_t count : voice_counts) {
+			double ns = measure(c, count);
+			if (first_count == 0) {
+				first_ns = ns;
+				first_count = count;
+			}
+			last_ns = ns;
+			last_count = count;
+			std::cout << "  " << std::setw(6) << count
+			          << "   " << std::setw(8) << ns
+			          << "   " << std::setw(14) << ns / count
+			          << "   " << std::setw(11) << (1.0e9 / 48000.0) / ns << "\n";
+		}
+		//fit cost == fixed + per_voice * count through the smallest and largest measurements:
+		double per_voice = (last_ns - first_ns) / double(last_count - first_count);
+		double fixed = first_ns - per_voice * first_count;
+		if (per_voice > 0.0) {
+			double max_voices = std::max(0.0, (ns_per_frame_budget - fixed) / per_voice);
+			std::cout << "  => about " << std::setprecision(0) << std::floor(max_voices) << std::setprecision(1)
+			          << " voices fit in the budget (extrapolated; " << per_voice << " ns/frame per voice, " << fixed << " ns/frame fixed)" << std::endl;
+		}
+	}
+
+	std::cout << "\n";
+	Sound::write_stats(std::cout, Sound::get_stats());
+
+	if (wav_file != "") {
+		std::cout << "\nWriting " << seconds << " seconds of 16 3D one-shot voices to '" << wav_file << "'." << std::endl;
+		Sound::stop_all_samples();
+		Sound::render(output.data(), 2048);
+		for (uint32_t v = 0; v < 16; ++v) {
+			Sound::play_3D(one_shot, 1.0f, glm::vec3(float(v) - 8.0f, 4.0f, 0.0f), 10.0f);
+		}
+		Sound::render_to_wav(wav_file, seconds);
+	}
+
+	return 0;
+
+#ifdef _WIN32
+	} catch (std::exception const &e) {
+		std::cerr << "Unhandled exception:\n" << e.what() << std::endl;
+		return 1;
+	} catch (...) {
+		std::cerr << "Unhandled exception (unknown type)." << std::endl;
+		throw;
+	}
+#endif
+}
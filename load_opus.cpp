@@ -1,53 +1,141 @@
 #include "load_opus.hpp"
+#include "mix_kernels.hpp"
 
 #include <opusfile.h>
 
+#include <algorithm>
 #include <cassert>
+#include <exception>
 #include <memory>
 #include <cmath>
 #include <stdexcept>
 #include <iostream>
+#include <thread>
 
-void load_opus(std::string const &filename, std::vector< float > *data_) {
-	assert(data_);
-	auto &data = *data_;
-	data.clear();
+//files at least this long (in samples) are decoded in parallel, in ranges at least this long:
+// (each range needs its own file handle and a seek, so short ranges aren't worth it)
+static constexpr ogg_int64_t const MIN_RANGE = 10 * 48000;
 
-	std::cout << "loading '" << filename << "'..."; std::cout.flush();
+//will hold opusfile * in a std::unique_ptr so that it will automatically be deleted:
+typedef std::unique_ptr< OggOpusFile, decltype(&op_free) > OpusFilePtr;
 
-	//will hold opusfile * int a std::unique_ptr so that it will automatically be deleted:
+static OpusFilePtr open_opus(std::string const &filename) {
 	int err = 0;
-	std::unique_ptr< OggOpusFile, decltype(&op_free) > op(
+	OpusFilePtr op(
 		op_open_file(filename.c_str(), &err), //pointer to hold
 		op_free //deletion function
 	);
 	if (err != 0) {
 		throw std::runtime_error("opusfile error " + std::to_string(err) + " opening \"" + filename + "\".");
 	}
+	return op;
+}
+
+//decode up to 'count' samples (downmixed to mono) from the current position of 'op' into 'out':
+// returns the number of samples decoded, which is less than 'count' if the file ends early (e.g., a damaged final page)
+static ogg_int64_t decode_range(std::string const &filename, OggOpusFile *op, float *out, ogg_int64_t count) {
+	std::vector< float > pcm(2*48000*2, 0.0f); //seems like reads are generally 960 samples so this is definitely overkill
+	ogg_int64_t decoded = 0;
+	while (decoded < count) {
+		int ret = op_read_float_stereo(op, pcm.data(), int(pcm.size()));
+		if (ret < 0) {
+			throw std::runtime_error("opusfile read error " + std::to_string(ret) + " reading \"" + filename + "\".");
+		} else if (ret == 0) {
+			break;
+		}
+		//positive return values are the number of samples read per channel:
+		uint32_t frames = uint32_t(std::min< ogg_int64_t >(ret, count - decoded));
+		downmix_stereo(pcm.data(), frames, out + decoded);
+		decoded += frames;
+	}
+	return decoded;
+}
+
+void load_opus(std::string const &filename, std::vector< float > *data_) {
+	assert(data_);
+	auto &data = *data_;
+	data.clear();
+
+	std::cout << "loading '" << filename << "'..."; std::cout.flush();
+
+	OpusFilePtr op = open_opus(filename);
 
 	//get length in samples:
 	ogg_int64_t length = op_pcm_total(op.get(), -1);
-	if (length >= 0) {
-		data.reserve(length);
-	} else {
+	if (length < 0) {
 		std::cerr << "WARNING: cannot estimate length of '" << filename << "', loading may be slow." << std::endl;
-		length = 0;
-		data.reserve(2*48000);
-	}
 
-	std::vector< float > pcm(2*48000*2, 0.0f); //seems like reads are generally 960 samples so this is definitely overkill
-	for (;;) {
-		int ret = op_read_float_stereo(op.get(), pcm.data(), int(pcm.size()));
-		if (ret >= 0) {
-			//positive return values are the number of samples read per channel; copy into data:
-			data.reserve(data.size() + ret);
-			for (uint32_t i = 0; i < uint32_t(ret); ++i) {
-				data.emplace_back((pcm[2*i] + pcm[2*i+1]) * 0.5f); //downmix to mono by averaging
+		//read until the end, growing data as needed:
+		std::vector< float > pcm(2*48000*2, 0.0f);
+		for (;;) {
+			int ret = op_read_float_stereo(op.get(), pcm.data(), int(pcm.size()));
+			if (ret < 0) {
+				throw std::runtime_error("opusfile read error " + std::to_string(ret) + " reading \"" + filename + "\".");
 			}
 			if (ret == 0) break;
-		} else {
-			throw std::runtime_error("opusfile read error " + std::to_string(ret) + " reading \"" + filename + "\".");
+			size_t at = data.size();
+			data.resize(at + ret);
+			downmix_stereo(pcm.data(), uint32_t(ret), data.data() + at);
 		}
+
+		std::cout << " done." << std::endl;
+		return;
+	}
+
+	data.resize(size_t(length));
+
+	//split long files into time ranges, each decoded by its own thread with its own file handle:
+	uint32_t ranges = uint32_t(std::max< ogg_int64_t >(1, std::min< ogg_int64_t >(std::thread::hardware_concurrency(), length / MIN_RANGE)));
+	//number of samples decoded in each range:
+	std::vector< ogg_int64_t > decoded(ranges, 0);
+	if (ranges == 1) {
+		decoded[0] = decode_range(filename, op.get(), data.data(), length);
+	} else {
+		std::vector< std::thread > workers;
+		std::vector< std::exception_ptr > errors(ranges);
+		for (uint32_t r = 0; r < ranges; ++r) {
+			ogg_int64_t begin = length * r / ranges;
+			ogg_int64_t end = length * (r + 1) / ranges;
+			//(the first range re-uses the already-open handle)
+			OggOpusFile *first = (r == 0 ? op.get() : nullptr);
+			workers.emplace_back([&, begin, end, first, r](){
+				try {
+					OpusFilePtr own(nullptr, op_free);
+					OggOpusFile *range_op = first;
+					if (!range_op) {
+						own = open_opus(filename);
+						range_op = own.get();
+						int ret = op_pcm_seek(range_op, begin);
+						if (ret != 0) {
+							throw std::runtime_error("opusfile error " + std::to_string(ret) + " seeking in \"" + filename + "\".");
+						}
+					}
+					decoded[r] = decode_range(filename, range_op, data.data() + begin, end - begin);
+				} catch (...) {
+					errors[r] = std::current_exception();
+				}
+			});
+		}
+		for (auto &worker : workers) {
+			worker.join();
+		}
+		for (auto &error : errors) {
+			if (error) std::rethrow_exception(error);
+		}
+	}
+
+	//ranges that ended early are left silent past where they stopped; if the last one did, the file is just shorter than reported:
+	// (as when decoding in one pass, a damaged or truncated file loads whatever could be decoded)
+	ogg_int64_t missing = 0;
+	for (uint32_t r = 0; r < ranges; ++r) {
+		ogg_int64_t begin = length * r / ranges;
+		ogg_int64_t end = length * (r + 1) / ranges;
+		missing += (end - begin) - decoded[r];
+	}
+	if (missing > 0) {
+		std::cerr << "WARNING: '" << filename << "' ended " << missing << " samples before its reported length; keeping what was decoded." << std::endl;
+		ogg_int64_t last_begin = length * (ranges - 1) / ranges;
+		data.resize(size_t(last_begin + decoded[ranges - 1]));
 	}
 
 	std::cout << " done." << std::endl;
@@ -1,13 +1,43 @@
 #include "load_wav.hpp"
+#include "Resampler.hpp"
+#include "mix_kernels.hpp"
 
 #include <SDL.h>
 
 #include <iostream>
+#include <fstream>
 #include <cassert>
 #include <algorithm>
+#include <memory>
 
 constexpr uint32_t AUDIO_RATE = 48000;
 
+//convert 'frames' frames of WAV data to float mono (averaging channels):
+static void convert_to_mono(Uint8 const *src, SDL_AudioFormat format, uint32_t channels, uint32_t frames, float *out) {
+	if (format == AUDIO_F32LSB && channels == 2) {
+		downmix_stereo(reinterpret_cast< float const * >(src), frames, out);
+		return;
+	}
+
+	//read a sample as a float in [-1,1]:
+	// (n.b. WAV data is little-endian, and this assumes a little-endian host, like the rest of the code)
+	float scale = 1.0f / float(channels);
+	auto convert = [&](auto const *samples, float to_float, float offset) {
+		for (uint32_t f = 0; f < frames; ++f) {
+			float sum = 0.0f;
+			for (uint32_t c = 0; c < channels; ++c) {
+				sum += float(samples[f * channels + c]) - offset;
+			}
+			out[f] = sum * (to_float * scale);
+		}
+	};
+	if (format == AUDIO_F32LSB) convert(reinterpret_cast< float const * >(src), 1.0f, 0.0f);
+	else if (format == AUDIO_S32LSB) convert(reinterpret_cast< int32_t const * >(src), 1.0f / 2147483648.0f, 0.0f);
+	else if (format == AUDIO_S16LSB) convert(reinterpret_cast< int16_t const * >(src), 1.0f / 32768.0f, 0.0f);
+	else if (format == AUDIO_U8) convert(src, 1.0f / 128.0f, 128.0f);
+	else assert(0 && "Format was checked when loading.");
+}
+
 void load_wav(std::string const &filename, std::vector< float > *data_) {
 	assert(data_);
 	auto &data = *data_;
@@ -20,31 +50,83 @@ void load_wav(std::string const &filename, std::vector< float > *data_) {
 	if (!have) {
 		throw std::runtime_error("Failed to load WAV file '" + filename + "'; SDL says \"" + std::string(SDL_GetError()) + "\"");
 	}
+	//hold audio_buf in a std::unique_ptr so that it will be freed even if conversion throws:
+	std::unique_ptr< Uint8, decltype(&SDL_FreeWAV) > audio(audio_buf, SDL_FreeWAV);
 
-	//based on the SDL_AudioCVT example in the docs: https://wiki.libsdl.org/SDL_AudioCVT
-	SDL_AudioCVT cvt;
-	SDL_BuildAudioCVT(&cvt, have->format, have->channels, have->freq, AUDIO_F32SYS, 1, AUDIO_RATE);
-	if (cvt.needed) {
-		std::cout << "WAV file '" + filename + "' didn't load as " + std::to_string(AUDIO_RATE) + " Hz, float32, mono; converting." << std::endl;
-		cvt.len = audio_len;
-		cvt.buf = (Uint8 *)SDL_malloc(cvt.len * cvt.len_mult);
-		SDL_memcpy(cvt.buf, audio_buf, audio_len);
-		SDL_ConvertAudio(&cvt);
-		int final_size = cvt.len_cvt;
-		assert(final_size >= 0 && final_size <= cvt.len * cvt.len_mult && "Converted audio should fit in buffer.");
-		assert(final_size % 4 == 0 && "Converted audio should consist of 4-byte elements.");
-		data.assign(reinterpret_cast< float * >(cvt.buf), reinterpret_cast< float * >(cvt.buf + final_size));
-		SDL_free(cvt.buf);
-	} else {
-		data.assign(reinterpret_cast< float * >(audio_buf), reinterpret_cast< float * >(audio_buf + audio_len));
+	if (!(have->format == AUDIO_F32LSB || have->format == AUDIO_S32LSB || have->format == AUDIO_S16LSB || have->format == AUDIO_U8)
+	 || have->channels == 0 || have->freq <= 0) {
+		throw std::runtime_error("WAV file '" + filename + "' has an unsupported format.");
 	}
-	SDL_FreeWAV(audio_buf);
+	uint32_t channels = have->channels;
+	uint32_t frame_bytes = SDL_AUDIO_BITSIZE(have->format) / 8 * channels;
+	uint32_t frames = audio_len / frame_bytes;
+	uint32_t rate = uint32_t(have->freq);
+
+	if (have->format == AUDIO_F32LSB && channels == 1 && rate == AUDIO_RATE) {
+		data.assign(reinterpret_cast< float * >(audio_buf), reinterpret_cast< float * >(audio_buf) + frames);
+		return;
+	}
+
+	std::cout << "WAV file '" + filename + "' didn't load as " + std::to_string(AUDIO_RATE) + " Hz, float32, mono; converting." << std::endl;
+
+	if (rate == AUDIO_RATE) {
+		//just downmix / convert, straight into the output:
+		data.resize(frames);
+		convert_to_mono(audio_buf, have->format, channels, frames, data.data());
+		return;
+	}
+
+	//downmix a chunk at a time and stream it through the resampler into the (presized) output:
+	Resampler resampler(rate, AUDIO_RATE);
+	uint32_t output_count = uint32_t((uint64_t(frames) * AUDIO_RATE + rate - 1) / rate); //outputs at input times before the end
+	data.resize(output_count);
+	std::vector< float > chunk(Resampler::MAX_INPUT);
+	uint32_t written = 0;
+	for (uint32_t begin = 0; begin < frames; begin += Resampler::MAX_INPUT) {
+		uint32_t count = std::min(Resampler::MAX_INPUT, frames - begin);
+		convert_to_mono(audio_buf + size_t(begin) * frame_bytes, have->format, channels, count, chunk.data());
+		//(outputs are only computed once the input is well past them, so these all land before output_count)
+		written += resampler.process(chunk.data(), count, data.data() + written);
+	}
+	//the last few outputs need the (silent) input past the end of the file:
+	std::vector< float > tail(resampler.max_output(resampler.taps));
+	uint32_t tail_count = resampler.flush(tail.data());
+	assert(written + tail_count >= output_count);
+	std::copy(tail.begin(), tail.begin() + (output_count - written), data.begin() + written);
+}
+
+void save_wav(std::string const &filename, std::vector< float > const &data, uint32_t channels, uint32_t rate) {
+	assert(channels > 0 && data.size() % channels == 0);
+
+	//canonical RIFF/WAVE header, format 3 (IEEE float); all fields little-endian:
+	std::vector< uint8_t > header;
+	auto put_u32 = [&header](uint32_t v) {
+		for (uint32_t b = 0; b < 4; ++b) header.emplace_back(uint8_t(v >> (8 * b)));
+	};
+	auto put_u16 = [&header](uint16_t v) {
+		header.emplace_back(uint8_t(v));
+		header.emplace_back(uint8_t(v >> 8));
+	};
+	auto put_tag = [&header](char const *tag) {
+		header.insert(header.end(), tag, tag + 4);
+	};
+
+	uint32_t data_bytes = uint32_t(data.size() * sizeof(float));
+	put_tag("RIFF"); put_u32(36 + data_bytes); put_tag("WAVE");
+	put_tag("fmt "); put_u32(16);
+	put_u16(3); //format: IEEE float
+	put_u16(uint16_t(channels));
+	put_u32(rate);
+	put_u32(rate * channels * uint32_t(sizeof(float))); //bytes per second
+	put_u16(uint16_t(channels * sizeof(float))); //bytes per frame
+	put_u16(32); //bits per sample
+	put_tag("data"); put_u32(data_bytes);
 
-	float min = 0.0f;
-	float max = 0.0f;
-	for (auto d : data) {
-		min = std::min(min, d);
-		max = std::max(max, d);
+	std::ofstream out(filename, std::ios::binary);
+	out.write(reinterpret_cast< char const * >(header.data()), header.size());
+	//n.b. assumes a little-endian host, like the rest of the code:
+	out.write(reinterpret_cast< char const * >(data.data()), data_bytes);
+	if (!out) {
+		throw std::runtime_error("Failed to write WAV file '" + filename + "'.");
 	}
-	std::cout << "Range: " << min << ", " << max << std::endl;
 }
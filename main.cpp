@@ -20,7 +20,10 @@
 #include <SDL.h>
 
 //...and for c++ standard library functions:
+#include <cerrno>
 #include <chrono>
+#include <cstdint>
+#include <cstdlib>
 #include <iostream>
 #include <stdexcept>
 #include <memory>
@@ -29,6 +32,18 @@
 #ifdef _WIN32
 extern "C" { uint32_t GetACP(); }
 #endif
+
+//parse the value of environment variable 'name' as a (non-negative, decimal) number; throws on anything else:
+static unsigned long parse_env_number(char const *name, char const *value) {
+	char *end = nullptr;
+	errno = 0;
+	unsigned long number = std::strtoul(value, &end, 10);
+	if (value[0] < '0' || value[0] > '9' || *end != '\0' || errno == ERANGE) {
+		throw std::runtime_error(std::string(name) + "='" + value + "' isn't a number.");
+	}
+	return number;
+}
+
 int main(int argc, char **argv) {
 #ifdef _WIN32
 	{ //when compiled on windows, check that code page is forced to utf-8 (makes file loading/saving work right):
@@ -109,8 +124,34 @@ int main(int argc, char **argv) {
 	//SDL_ShowCursor(SDL_DISABLE);
 
 	//------------ init sound --------------
+	//set AUDIO_BUFFER_FRAMES=<128|256|512|1024> in the environment for lower (or higher) audio latency:
+	// (a bad value is reported and ignored, like other audio setup problems)
+	if (char const *audio_buffer_frames = std::getenv("AUDIO_BUFFER_FRAMES")) {
+		try {
+			unsigned long frames = parse_env_number("AUDIO_BUFFER_FRAMES", audio_buffer_frames);
+			Sound::set_buffer_frames(uint32_t(std::min< unsigned long >(frames, 0xffffffffUL)));
+		} catch (std::exception const &e) {
+			std::cerr << "WARNING: " << e.what() << " Using the default audio buffer size." << std::endl;
+		}
+	}
+
 	Sound::init();
 
+	//set AUDIO_STATS=<file> in the environment to get a report on mixer performance at exit:
+	if (char const *audio_stats = std::getenv("AUDIO_STATS")) {
+		Sound::set_stats_file(audio_stats);
+	}
+
+	//set SAMPLE_MEMORY_BUDGET=<megabytes> in the environment to decode samples only when played, and drop unused ones to stay in budget:
+	if (char const *sample_memory_budget = std::getenv("SAMPLE_MEMORY_BUDGET")) {
+		try {
+			unsigned long megabytes = parse_env_number("SAMPLE_MEMORY_BUDGET", sample_memory_budget);
+			Sound::set_sample_memory_budget(size_t(std::min< unsigned long >(megabytes, SIZE_MAX / (1024 * 1024))) * 1024 * 1024);
+		} catch (std::exception const &e) {
+			std::cerr << "WARNING: " << e.what() << " Not using a sample memory budget." << std::endl;
+		}
+	}
+
 	//------------ load assets --------------
 	call_load_functions();
 
@@ -183,6 +224,8 @@ int main(int argc, char **argv) {
 
 			Mode::current->update(elapsed);
 			if (!Mode::current) break;
+
+			Sound::update();
 		}
 
 		{ //(3) call the current mode's "draw" function to produce output:
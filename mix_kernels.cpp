@@ -0,0 +1,825 @@
+#include "mix_kernels.hpp"
+
+#include <SDL.h>
+
+#include <algorithm>
+#include <cmath>
+
+//x86 targets get SSE2 (always) and AVX2 (if the CPU has it) variants:
+#if defined(__x86_64__) || defined(_M_X64) || ((defined(__i386__) || defined(_M_IX86)) && (defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)))
+#define MIX_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+//gcc/clang need to be told which functions may use AVX2 instructions; MSVC doesn't:
+#if defined(MIX_KERNELS_X86) && (defined(__GNUC__) || defined(__clang__))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+namespace {
+
+//scalar version; also handles the leftover frames of the vector versions:
+void mix_mono_to_stereo_scalar(float const *src, uint32_t count, float *lr, float l, float r, float dl, float dr) {
+	for (uint32_t k = 0; k < count; ++k) {
+		lr[2*k+0] += l * src[k];
+		lr[2*k+1] += r * src[k];
+		l += dl;
+		r += dr;
+	}
+}
+
+void mix_int16_mono_to_stereo_scalar(int16_t const *src, uint32_t count, float *lr, float l, float r, float dl, float dr) {
+	for (uint32_t k = 0; k < count; ++k) {
+		float s = float(src[k]);
+		lr[2*k+0] += l * s;
+		lr[2*k+1] += r * s;
+		l += dl;
+		r += dr;
+	}
+}
+
+void mix_stereo_scalar(float const *src, uint32_t frames, float *lr, float gain, float dgain) {
+	for (uint32_t k = 0; k < frames; ++k) {
+		lr[2*k+0] += gain * src[2*k+0];
+		lr[2*k+1] += gain * src[2*k+1];
+		gain += dgain;
+	}
+}
+
+void one_pole_stereo_scalar(float *lr, uint32_t frames, float a, float state[2]) {
+	float l = state[0];
+	float r = state[1];
+	for (uint32_t k = 0; k < frames; ++k) {
+		l += a * (lr[2*k+0] - l);
+		r += a * (lr[2*k+1] - r);
+		lr[2*k+0] = l;
+		lr[2*k+1] = r;
+	}
+	state[0] = l;
+	state[1] = r;
+}
+
+//equal-power gains for a pan amount 'amt' in [-1,1] (-1 == most left), as a polynomial instead of std::cos/std::sin:
+// with phi = pi/4 * amt, the gains are cos(pi/4 + phi) = (cos(phi) - sin(phi)) / sqrt(2) and sin(pi/4 + phi) = (cos(phi) + sin(phi)) / sqrt(2);
+// over |phi| <= pi/4 the Taylor series below are good to ~3e-7
+// (the vector versions evaluate exactly the same polynomials, so all variants agree)
+constexpr float const QUARTER_PI = 0.78539816f;
+constexpr float const SQRT_HALF = 0.70710678f;
+constexpr float const SIN_C3 = -1.0f / 6.0f, SIN_C5 = 1.0f / 120.0f, SIN_C7 = -1.0f / 5040.0f;
+constexpr float const COS_C2 = -1.0f / 2.0f, COS_C4 = 1.0f / 24.0f, COS_C6 = -1.0f / 720.0f, COS_C8 = 1.0f / 40320.0f;
+
+inline void pan_gains(float amt, float *left, float *right) {
+	float phi = QUARTER_PI * std::max(-1.0f, std::min(1.0f, amt));
+	float p2 = phi * phi;
+	float s = phi * (1.0f + p2 * (SIN_C3 + p2 * (SIN_C5 + p2 * SIN_C7)));
+	float c = 1.0f + p2 * (COS_C2 + p2 * (COS_C4 + p2 * (COS_C6 + p2 * COS_C8)));
+	*left = (c - s) * SQRT_HALF;
+	*right = (c + s) * SQRT_HALF;
+}
+
+void pan_3d_scalar(uint32_t count, float const *x, float const *y, float const *z, float const *half_radius, float const *volume,
+	float const listener[3], float const right[3], float *left_gain, float *right_gain) {
+	for (uint32_t i = 0; i < count; ++i) {
+		float tx = x[i] - listener[0];
+		float ty = y[i] - listener[1];
+		float tz = z[i] - listener[2];
+		float distance = std::sqrt(tx * tx + ty * ty + tz * tz);
+		if (distance == 0.0f) {
+			left_gain[i] = right_gain[i] = std::sqrt(2.0f) * volume[i];
+		} else {
+			float l, r;
+			pan_gains((right[0] * tx + right[1] * ty + right[2] * tz) / distance, &l, &r);
+			//linear distance attenuation, 0.5 at half_radius: 1 / (1 + distance / half_radius)
+			// (written with 1 / half_radius, which is 0 for the default infinite radius, so that case gives exactly 1 rather than inf / inf)
+			float att = volume[i] / (1.0f + distance * (1.0f / half_radius[i]));
+			left_gain[i] = l * att;
+			right_gain[i] = r * att;
+		}
+	}
+}
+
+void fft_radix4_pass_scalar(float const *x_re, float const *x_im, float *y_re, float *y_im, uint32_t quarter, uint32_t stride, float const *w_re, float const *w_im) {
+	for (uint32_t p = 0; p < quarter; ++p) {
+		float w1r = w_re[p], w1i = w_im[p];
+		float w2r = w_re[quarter + p], w2i = w_im[quarter + p];
+		float w3r = w_re[2*quarter + p], w3i = w_im[2*quarter + p];
+		for (uint32_t q = 0; q < stride; ++q) {
+			uint32_t i = q + stride * p;
+			uint32_t o = q + stride * 4 * p;
+			float ar = x_re[i], ai = x_im[i];
+			float br = x_re[i + stride * quarter], bi = x_im[i + stride * quarter];
+			float cr = x_re[i + 2 * stride * quarter], ci = x_im[i + 2 * stride * quarter];
+			float dr = x_re[i + 3 * stride * quarter], di = x_im[i + 3 * stride * quarter];
+			float apc_r = ar + cr, apc_i = ai + ci;
+			float amc_r = ar - cr, amc_i = ai - ci;
+			float bpd_r = br + dr, bpd_i = bi + di;
+			float bmd_r = br - dr, bmd_i = bi - di;
+
+			y_re[o] = apc_r + bpd_r;
+			y_im[o] = apc_i + bpd_i;
+
+			float t1r = amc_r + bmd_i, t1i = amc_i - bmd_r;
+			y_re[o + stride] = w1r * t1r - w1i * t1i;
+			y_im[o + stride] = w1r * t1i + w1i * t1r;
+
+			float t2r = apc_r - bpd_r, t2i = apc_i - bpd_i;
+			y_re[o + 2 * stride] = w2r * t2r - w2i * t2i;
+			y_im[o + 2 * stride] = w2r * t2i + w2i * t2r;
+
+			float t3r = amc_r - bmd_i, t3i = amc_i + bmd_r;
+			y_re[o + 3 * stride] = w3r * t3r - w3i * t3i;
+			y_im[o + 3 * stride] = w3r * t3i + w3i * t3r;
+		}
+	}
+}
+
+void complex_mac_scalar(float const *a_re, float const *a_im, float const *b_re, float const *b_im, uint32_t count, float *acc_re, float *acc_im) {
+	for (uint32_t k = 0; k < count; ++k) {
+		acc_re[k] += a_re[k] * b_re[k] - a_im[k] * b_im[k];
+		acc_im[k] += a_re[k] * b_im[k] + a_im[k] * b_re[k];
+	}
+}
+
+void downmix_stereo_scalar(float const *lr, uint32_t frames, float *mono) {
+	for (uint32_t k = 0; k < frames; ++k) {
+		mono[k] = (lr[2*k+0] + lr[2*k+1]) * 0.5f;
+	}
+}
+
+float dot_product_scalar(float const *a, float const *b, uint32_t count) {
+	float sum = 0.0f;
+	for (uint32_t k = 0; k < count; ++k) {
+		sum += a[k] * b[k];
+	}
+	return sum;
+}
+
+//playhead position for output k (the vector versions evaluate exactly the same expression, so all variants agree):
+inline float playhead(float k, float pos, float rate, float drate) {
+	return pos + k * rate + (0.5f * k * (k - 1.0f)) * drate;
+}
+
+//Catmull-Rom spline through a, b, c, d, evaluated at t in [0,1) between b and c:
+inline float catmull_rom(float a, float b, float c, float d, float t) {
+	return b + 0.5f * t * ((c - a) + t * ((2.0f * a - 5.0f * b + 4.0f * c - d) + t * (3.0f * (b - c) + (d - a))));
+}
+
+//outputs [begin, count) (the vector versions use these for their leftovers):
+void interpolate_linear_from(uint32_t begin, float const *src, uint32_t count, float pos, float rate, float drate, float *out) {
+	for (uint32_t k = begin; k < count; ++k) {
+		float p = playhead(float(k), pos, rate, drate);
+		int32_t n = int32_t(p);
+		float t = p - float(n);
+		out[k] = src[n] + t * (src[n+1] - src[n]);
+	}
+}
+
+void interpolate_cubic_from(uint32_t begin, float const *src, uint32_t count, float pos, float rate, float drate, float *out) {
+	for (uint32_t k = begin; k < count; ++k) {
+		float p = playhead(float(k), pos, rate, drate);
+		int32_t n = int32_t(p);
+		float t = p - float(n);
+		out[k] = catmull_rom(src[n-1], src[n], src[n+1], src[n+2], t);
+	}
+}
+
+void interpolate_linear_scalar(float const *src, uint32_t count, float pos, float rate, float drate, float *out) {
+	interpolate_linear_from(0, src, count, pos, rate, drate, out);
+}
+
+void interpolate_cubic_scalar(float const *src, uint32_t count, float pos, float rate, float drate, float *out) {
+	interpolate_cubic_from(0, src, count, pos, rate, drate, out);
+}
+
+#ifdef MIX_KERNELS_X86
+
+//SSE2 version: 4 frames (two LRLR registers) per iteration.
+void mix_mono_to_stereo_sse2(float const *src, uint32_t count, float *lr, float l, float r, float dl, float dr) {
+	//gains for frames 0,1 and 2,3 (as LRLR):
+	__m128 g01 = _mm_setr_ps(l, r, l + dl, r + dr);
+	__m128 g23 = _mm_setr_ps(l + 2.0f * dl, r + 2.0f * dr, l + 3.0f * dl, r + 3.0f * dr);
+	__m128 step = _mm_setr_ps(4.0f * dl, 4.0f * dr, 4.0f * dl, 4.0f * dr);
+
+	uint32_t k = 0;
+	for (; k + 4 <= count; k += 4) {
+		__m128 s = _mm_loadu_ps(src + k);
+		__m128 s01 = _mm_unpacklo_ps(s, s); //s0 s0 s1 s1
+		__m128 s23 = _mm_unpackhi_ps(s, s); //s2 s2 s3 s3
+
+		float *out = lr + 2*k;
+		_mm_storeu_ps(out + 0, _mm_add_ps(_mm_loadu_ps(out + 0), _mm_mul_ps(g01, s01)));
+		_mm_storeu_ps(out + 4, _mm_add_ps(_mm_loadu_ps(out + 4), _mm_mul_ps(g23, s23)));
+
+		g01 = _mm_add_ps(g01, step);
+		g23 = _mm_add_ps(g23, step);
+	}
+
+	mix_mono_to_stereo_scalar(src + k, count - k, lr + 2*k, l + float(k) * dl, r + float(k) * dr, dl, dr);
+}
+
+//SSE2 version: 4 frames per iteration, converting int16 -> int32 -> float as it goes.
+void mix_int16_mono_to_stereo_sse2(int16_t const *src, uint32_t count, float *lr, float l, float r, float dl, float dr) {
+	__m128 g01 = _mm_setr_ps(l, r, l + dl, r + dr);
+	__m128 g23 = _mm_setr_ps(l + 2.0f * dl, r + 2.0f * dr, l + 3.0f * dl, r + 3.0f * dr);
+	__m128 step = _mm_setr_ps(4.0f * dl, 4.0f * dr, 4.0f * dl, 4.0f * dr);
+
+	uint32_t k = 0;
+	for (; k + 4 <= count; k += 4) {
+		__m128i i16 = _mm_loadl_epi64(reinterpret_cast< __m128i const * >(src + k));
+		__m128i i32 = _mm_srai_epi32(_mm_unpacklo_epi16(i16, i16), 16); //(sign extend)
+		__m128 s = _mm_cvtepi32_ps(i32);
+		__m128 s01 = _mm_unpacklo_ps(s, s);
+		__m128 s23 = _mm_unpackhi_ps(s, s);
+
+		float *out = lr + 2*k;
+		_mm_storeu_ps(out + 0, _mm_add_ps(_mm_loadu_ps(out + 0), _mm_mul_ps(g01, s01)));
+		_mm_storeu_ps(out + 4, _mm_add_ps(_mm_loadu_ps(out + 4), _mm_mul_ps(g23, s23)));
+
+		g01 = _mm_add_ps(g01, step);
+		g23 = _mm_add_ps(g23, step);
+	}
+
+	mix_int16_mono_to_stereo_scalar(src + k, count - k, lr + 2*k, l + float(k) * dl, r + float(k) * dr, dl, dr);
+}
+
+//SSE2 version: 4 frames (two LRLR registers) per iteration.
+void mix_stereo_sse2(float const *src, uint32_t frames, float *lr, float gain, float dgain) {
+	__m128 g01 = _mm_setr_ps(gain, gain, gain + dgain, gain + dgain);
+	__m128 g23 = _mm_add_ps(g01, _mm_set1_ps(2.0f * dgain));
+	__m128 step = _mm_set1_ps(4.0f * dgain);
+
+	uint32_t k = 0;
+	for (; k + 4 <= frames; k += 4) {
+		float *out = lr + 2*k;
+		_mm_storeu_ps(out + 0, _mm_add_ps(_mm_loadu_ps(out + 0), _mm_mul_ps(g01, _mm_loadu_ps(src + 2*k + 0))));
+		_mm_storeu_ps(out + 4, _mm_add_ps(_mm_loadu_ps(out + 4), _mm_mul_ps(g23, _mm_loadu_ps(src + 2*k + 4))));
+		g01 = _mm_add_ps(g01, step);
+		g23 = _mm_add_ps(g23, step);
+	}
+
+	mix_stereo_scalar(src + 2*k, frames - k, lr + 2*k, gain + float(k) * dgain, dgain);
+}
+
+//SSE2 version: one frame (both channels, in the low lanes) per step.
+void one_pole_stereo_sse2(float *lr, uint32_t frames, float a, float state[2]) {
+	__m128 y = _mm_castsi128_ps(_mm_loadl_epi64(reinterpret_cast< __m128i const * >(state)));
+	__m128 av = _mm_set1_ps(a);
+	for (uint32_t k = 0; k < frames; ++k) {
+		__m128 x = _mm_castsi128_ps(_mm_loadl_epi64(reinterpret_cast< __m128i const * >(lr + 2*k)));
+		y = _mm_add_ps(y, _mm_mul_ps(av, _mm_sub_ps(x, y)));
+		_mm_storel_epi64(reinterpret_cast< __m128i * >(lr + 2*k), _mm_castps_si128(y));
+	}
+	_mm_storel_epi64(reinterpret_cast< __m128i * >(state), _mm_castps_si128(y));
+}
+
+//SSE2 version: 4 sources per iteration.
+void pan_3d_sse2(uint32_t count, float const *x, float const *y, float const *z, float const *half_radius, float const *volume,
+	float const listener[3], float const right[3], float *left_gain, float *right_gain) {
+	__m128 lx = _mm_set1_ps(listener[0]), ly = _mm_set1_ps(listener[1]), lz = _mm_set1_ps(listener[2]);
+	__m128 rx = _mm_set1_ps(right[0]), ry = _mm_set1_ps(right[1]), rz = _mm_set1_ps(right[2]);
+	__m128 one = _mm_set1_ps(1.0f);
+
+	uint32_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128 tx = _mm_sub_ps(_mm_loadu_ps(x + i), lx);
+		__m128 ty = _mm_sub_ps(_mm_loadu_ps(y + i), ly);
+		__m128 tz = _mm_sub_ps(_mm_loadu_ps(z + i), lz);
+		__m128 distance = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, tx), _mm_mul_ps(ty, ty)), _mm_mul_ps(tz, tz)));
+		__m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(rx, tx), _mm_mul_ps(ry, ty)), _mm_mul_ps(rz, tz));
+		__m128 amt = _mm_max_ps(_mm_set1_ps(-1.0f), _mm_min_ps(one, _mm_div_ps(dot, distance)));
+
+		__m128 phi = _mm_mul_ps(_mm_set1_ps(QUARTER_PI), amt);
+		__m128 p2 = _mm_mul_ps(phi, phi);
+		__m128 s = _mm_add_ps(_mm_set1_ps(SIN_C5), _mm_mul_ps(p2, _mm_set1_ps(SIN_C7)));
+		s = _mm_add_ps(_mm_set1_ps(SIN_C3), _mm_mul_ps(p2, s));
+		s = _mm_mul_ps(phi, _mm_add_ps(one, _mm_mul_ps(p2, s)));
+		__m128 c = _mm_add_ps(_mm_set1_ps(COS_C6), _mm_mul_ps(p2, _mm_set1_ps(COS_C8)));
+		c = _mm_add_ps(_mm_set1_ps(COS_C4), _mm_mul_ps(p2, c));
+		c = _mm_add_ps(_mm_set1_ps(COS_C2), _mm_mul_ps(p2, c));
+		c = _mm_add_ps(one, _mm_mul_ps(p2, c));
+
+		__m128 inv_radius = _mm_div_ps(one, _mm_loadu_ps(half_radius + i));
+		__m128 att = _mm_div_ps(_mm_loadu_ps(volume + i), _mm_add_ps(one, _mm_mul_ps(distance, inv_radius)));
+		att = _mm_mul_ps(att, _mm_set1_ps(SQRT_HALF));
+		__m128 l = _mm_mul_ps(_mm_sub_ps(c, s), att);
+		__m128 r = _mm_mul_ps(_mm_add_ps(c, s), att);
+
+		//sources right on top of the listener get sqrt(2) * volume on both sides:
+		__m128 at_listener = _mm_cmpeq_ps(distance, _mm_setzero_ps());
+		__m128 centered = _mm_and_ps(at_listener, _mm_mul_ps(_mm_set1_ps(1.41421356f), _mm_loadu_ps(volume + i)));
+		_mm_storeu_ps(left_gain + i, _mm_or_ps(_mm_andnot_ps(at_listener, l), centered));
+		_mm_storeu_ps(right_gain + i, _mm_or_ps(_mm_andnot_ps(at_listener, r), centered));
+	}
+
+	pan_3d_scalar(count - i, x + i, y + i, z + i, half_radius + i, volume + i, listener, right, left_gain + i, right_gain + i);
+}
+
+//SSE2 version of one radix-4 butterfly over four lanes (returns the four outputs, before twiddling, in place of a..d):
+inline void radix4_butterfly_sse2(
+	__m128 &ar, __m128 &ai, __m128 &br, __m128 &bi, __m128 &cr, __m128 &ci, __m128 &dr, __m128 &di) {
+	__m128 apc_r = _mm_add_ps(ar, cr), apc_i = _mm_add_ps(ai, ci);
+	__m128 amc_r = _mm_sub_ps(ar, cr), amc_i = _mm_sub_ps(ai, ci);
+	__m128 bpd_r = _mm_add_ps(br, dr), bpd_i = _mm_add_ps(bi, di);
+	__m128 bmd_r = _mm_sub_ps(br, dr), bmd_i = _mm_sub_ps(bi, di);
+	ar = _mm_add_ps(apc_r, bpd_r); ai = _mm_add_ps(apc_i, bpd_i);
+	br = _mm_add_ps(amc_r, bmd_i); bi = _mm_sub_ps(amc_i, bmd_r);
+	cr = _mm_sub_ps(apc_r, bpd_r); ci = _mm_sub_ps(apc_i, bpd_i);
+	dr = _mm_sub_ps(amc_r, bmd_i); di = _mm_add_ps(amc_i, bmd_r);
+}
+
+//(x_r, x_i) *= (w_r, w_i):
+inline void complex_mul_sse2(__m128 &xr, __m128 &xi, __m128 wr, __m128 wi) {
+	__m128 r = _mm_sub_ps(_mm_mul_ps(wr, xr), _mm_mul_ps(wi, xi));
+	xi = _mm_add_ps(_mm_mul_ps(wr, xi), _mm_mul_ps(wi, xr));
+	xr = r;
+}
+
+//SSE2 version: four transforms (q) per iteration when stride >= 4; otherwise (the first pass) four butterflies (p),
+// with a 4x4 transpose to interleave their outputs.
+void fft_radix4_pass_sse2(float const *x_re, float const *x_im, float *y_re, float *y_im, uint32_t quarter, uint32_t stride, float const *w_re, float const *w_im) {
+	uint32_t const span = stride * quarter;
+	if (stride >= 4) {
+		for (uint32_t p = 0; p < quarter; ++p) {
+			__m128 w1r = _mm_set1_ps(w_re[p]), w1i = _mm_set1_ps(w_im[p]);
+			__m128 w2r = _mm_set1_ps(w_re[quarter + p]), w2i = _mm_set1_ps(w_im[quarter + p]);
+			__m128 w3r = _mm_set1_ps(w_re[2*quarter + p]), w3i = _mm_set1_ps(w_im[2*quarter + p]);
+			for (uint32_t q = 0; q < stride; q += 4) {
+				uint32_t i = q + stride * p;
+				uint32_t o = q + stride * 4 * p;
+				__m128 ar = _mm_loadu_ps(x_re + i), ai = _mm_loadu_ps(x_im + i);
+				__m128 br = _mm_loadu_ps(x_re + i + span), bi = _mm_loadu_ps(x_im + i + span);
+				__m128 cr = _mm_loadu_ps(x_re + i + 2 * span), ci = _mm_loadu_ps(x_im + i + 2 * span);
+				__m128 dr = _mm_loadu_ps(x_re + i + 3 * span), di = _mm_loadu_ps(x_im + i + 3 * span);
+				radix4_butterfly_sse2(ar, ai, br, bi, cr, ci, dr, di);
+				complex_mul_sse2(br, bi, w1r, w1i);
+				complex_mul_sse2(cr, ci, w2r, w2i);
+				complex_mul_sse2(dr, di, w3r, w3i);
+				_mm_storeu_ps(y_re + o, ar); _mm_storeu_ps(y_im + o, ai);
+				_mm_storeu_ps(y_re + o + stride, br); _mm_storeu_ps(y_im + o + stride, bi);
+				_mm_storeu_ps(y_re + o + 2 * stride, cr); _mm_storeu_ps(y_im + o + 2 * stride, ci);
+				_mm_storeu_ps(y_re + o + 3 * stride, dr); _mm_storeu_ps(y_im + o + 3 * stride, di);
+			}
+		}
+	} else if (stride == 1 && quarter % 4 == 0) {
+		for (uint32_t p = 0; p < quarter; p += 4) {
+			__m128 ar = _mm_loadu_ps(x_re + p), ai = _mm_loadu_ps(x_im + p);
+			__m128 br = _mm_loadu_ps(x_re + p + span), bi = _mm_loadu_ps(x_im + p + span);
+			__m128 cr = _mm_loadu_ps(x_re + p + 2 * span), ci = _mm_loadu_ps(x_im + p + 2 * span);
+			__m128 dr = _mm_loadu_ps(x_re + p + 3 * span), di = _mm_loadu_ps(x_im + p + 3 * span);
+			radix4_butterfly_sse2(ar, ai, br, bi, cr, ci, dr, di);
+			complex_mul_sse2(br, bi, _mm_loadu_ps(w_re + p), _mm_loadu_ps(w_im + p));
+			complex_mul_sse2(cr, ci, _mm_loadu_ps(w_re + quarter + p), _mm_loadu_ps(w_im + quarter + p));
+			complex_mul_sse2(dr, di, _mm_loadu_ps(w_re + 2*quarter + p), _mm_loadu_ps(w_im + 2*quarter + p));
+			//lane j of a,b,c,d are outputs 4(p+j) + 0,1,2,3:
+			_MM_TRANSPOSE4_PS(ar, br, cr, dr);
+			_MM_TRANSPOSE4_PS(ai, bi, ci, di);
+			_mm_storeu_ps(y_re + 4*p + 0, ar); _mm_storeu_ps(y_im + 4*p + 0, ai);
+			_mm_storeu_ps(y_re + 4*p + 4, br); _mm_storeu_ps(y_im + 4*p + 4, bi);
+			_mm_storeu_ps(y_re + 4*p + 8, cr); _mm_storeu_ps(y_im + 4*p + 8, ci);
+			_mm_storeu_ps(y_re + 4*p + 12, dr); _mm_storeu_ps(y_im + 4*p + 12, di);
+		}
+	} else {
+		fft_radix4_pass_scalar(x_re, x_im, y_re, y_im, quarter, stride, w_re, w_im);
+	}
+}
+
+//SSE2 version: 4 bins per iteration.
+void complex_mac_sse2(float const *a_re, float const *a_im, float const *b_re, float const *b_im, uint32_t count, float *acc_re, float *acc_im) {
+	uint32_t k = 0;
+	for (; k + 4 <= count; k += 4) {
+		__m128 ar = _mm_loadu_ps(a_re + k), ai = _mm_loadu_ps(a_im + k);
+		__m128 br = _mm_loadu_ps(b_re + k), bi = _mm_loadu_ps(b_im + k);
+		_mm_storeu_ps(acc_re + k, _mm_add_ps(_mm_loadu_ps(acc_re + k), _mm_sub_ps(_mm_mul_ps(ar, br), _mm_mul_ps(ai, bi))));
+		_mm_storeu_ps(acc_im + k, _mm_add_ps(_mm_loadu_ps(acc_im + k), _mm_add_ps(_mm_mul_ps(ar, bi), _mm_mul_ps(ai, br))));
+	}
+	complex_mac_scalar(a_re + k, a_im + k, b_re + k, b_im + k, count - k, acc_re + k, acc_im + k);
+}
+
+//SSE2 version: 4 frames (two LRLR registers) per iteration.
+void downmix_stereo_sse2(float const *lr, uint32_t frames, float *mono) {
+	__m128 half = _mm_set1_ps(0.5f);
+	uint32_t k = 0;
+	for (; k + 4 <= frames; k += 4) {
+		__m128 a = _mm_loadu_ps(lr + 2*k + 0); //L0 R0 L1 R1
+		__m128 b = _mm_loadu_ps(lr + 2*k + 4); //L2 R2 L3 R3
+		__m128 l = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+		__m128 r = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+		_mm_storeu_ps(mono + k, _mm_mul_ps(_mm_add_ps(l, r), half));
+	}
+	downmix_stereo_scalar(lr + 2*k, frames - k, mono + k);
+}
+
+//SSE2 version: 4 products per iteration.
+float dot_product_sse2(float const *a, float const *b, uint32_t count) {
+	__m128 sum = _mm_setzero_ps();
+	uint32_t k = 0;
+	for (; k + 4 <= count; k += 4) {
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(a + k), _mm_loadu_ps(b + k)));
+	}
+	//horizontal sum:
+	sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+	sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+	return _mm_cvtss_f32(sum) + dot_product_scalar(a + k, b + k, count - k);
+}
+
+//SSE2 helper: playhead positions for outputs k, k+1, k+2, k+3 (fk holds them as floats), split into whole and fractional parts:
+inline void playheads_sse2(__m128 fk, __m128 pos, __m128 rate, __m128 drate, int32_t n[4], __m128 *t) {
+	__m128 tri = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), fk), _mm_sub_ps(fk, _mm_set1_ps(1.0f)));
+	__m128 p = _mm_add_ps(_mm_add_ps(pos, _mm_mul_ps(fk, rate)), _mm_mul_ps(tri, drate));
+	__m128i whole = _mm_cvttps_epi32(p);
+	*t = _mm_sub_ps(p, _mm_cvtepi32_ps(whole));
+	_mm_storeu_si128(reinterpret_cast< __m128i * >(n), whole);
+}
+
+//SSE2 version: 4 outputs per iteration (SSE2 has no gather, so each output's neighbors are loaded separately and transposed).
+void interpolate_linear_sse2(float const *src, uint32_t count, float pos, float rate, float drate, float *out) {
+	__m128 vpos = _mm_set1_ps(pos), vrate = _mm_set1_ps(rate), vdrate = _mm_set1_ps(drate);
+	__m128 fk = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+	int32_t n[4];
+	uint32_t k = 0;
+	for (; k + 4 <= count; k += 4) {
+		__m128 t;
+		playheads_sse2(fk, vpos, vrate, vdrate, n, &t);
+		//(each load picks up src[n], src[n+1])
+		__m128 x0 = _mm_castpd_ps(_mm_load_sd(reinterpret_cast< double const * >(src + n[0])));
+		__m128 x1 = _mm_castpd_ps(_mm_load_sd(reinterpret_cast< double const * >(src + n[1])));
+		__m128 x2 = _mm_castpd_ps(_mm_load_sd(reinterpret_cast< double const * >(src + n[2])));
+		__m128 x3 = _mm_castpd_ps(_mm_load_sd(reinterpret_cast< double const * >(src + n[3])));
+		__m128 x01 = _mm_unpacklo_ps(x0, x1);
+		__m128 x23 = _mm_unpacklo_ps(x2, x3);
+		__m128 b = _mm_movelh_ps(x01, x23);
+		__m128 c = _mm_movehl_ps(x23, x01);
+		_mm_storeu_ps(out + k, _mm_add_ps(b, _mm_mul_ps(t, _mm_sub_ps(c, b))));
+		fk = _mm_add_ps(fk, _mm_set1_ps(4.0f));
+	}
+	interpolate_linear_from(k, src, count, pos, rate, drate, out);
+}
+
+void interpolate_cubic_sse2(float const *src, uint32_t count, float pos, float rate, float drate, float *out) {
+	__m128 vpos = _mm_set1_ps(pos), vrate = _mm_set1_ps(rate), vdrate = _mm_set1_ps(drate);
+	__m128 fk = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+	__m128 half = _mm_set1_ps(0.5f), two = _mm_set1_ps(2.0f), three = _mm_set1_ps(3.0f), four = _mm_set1_ps(4.0f), five = _mm_set1_ps(5.0f);
+	int32_t n[4];
+	uint32_t k = 0;
+	for (; k + 4 <= count; k += 4) {
+		__m128 t;
+		playheads_sse2(fk, vpos, vrate, vdrate, n, &t);
+		//(each load picks up src[n-1] through src[n+2]; the transpose turns them into a, b, c, d for all four outputs)
+		__m128 a = _mm_loadu_ps(src + n[0] - 1);
+		__m128 b = _mm_loadu_ps(src + n[1] - 1);
+		__m128 c = _mm_loadu_ps(src + n[2] - 1);
+		__m128 d = _mm_loadu_ps(src + n[3] - 1);
+		_MM_TRANSPOSE4_PS(a, b, c, d);
+		__m128 c3 = _mm_add_ps(_mm_mul_ps(three, _mm_sub_ps(b, c)), _mm_sub_ps(d, a));
+		__m128 c2 = _mm_sub_ps(_mm_add_ps(_mm_sub_ps(_mm_mul_ps(two, a), _mm_mul_ps(five, b)), _mm_mul_ps(four, c)), d);
+		__m128 poly = _mm_add_ps(_mm_sub_ps(c, a), _mm_mul_ps(t, _mm_add_ps(c2, _mm_mul_ps(t, c3))));
+		_mm_storeu_ps(out + k, _mm_add_ps(b, _mm_mul_ps(_mm_mul_ps(half, t), poly)));
+		fk = _mm_add_ps(fk, four);
+	}
+	interpolate_cubic_from(k, src, count, pos, rate, drate, out);
+}
+
+//AVX2 version: 8 frames (two LRLRLRLR registers) per iteration.
+TARGET_AVX2 void mix_mono_to_stereo_avx2(float const *src, uint32_t count, float *lr, float l, float r, float dl, float dr) {
+	__m256 g0 = _mm256_setr_ps(
+		l, r, l + dl, r + dr,
+		l + 2.0f * dl, r + 2.0f * dr, l + 3.0f * dl, r + 3.0f * dr);
+	__m256 g1 = _mm256_add_ps(g0, _mm256_setr_ps(
+		4.0f * dl, 4.0f * dr, 4.0f * dl, 4.0f * dr,
+		4.0f * dl, 4.0f * dr, 4.0f * dl, 4.0f * dr));
+	__m256 step = _mm256_setr_ps(
+		8.0f * dl, 8.0f * dr, 8.0f * dl, 8.0f * dr,
+		8.0f * dl, 8.0f * dr, 8.0f * dl, 8.0f * dr);
+
+	uint32_t k = 0;
+	for (; k + 8 <= count; k += 8) {
+		__m128 s0 = _mm_loadu_ps(src + k);
+		__m128 s1 = _mm_loadu_ps(src + k + 4);
+		//duplicate each sample into an L and R lane:
+		__m256 d0 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_unpacklo_ps(s0, s0)), _mm_unpackhi_ps(s0, s0), 1);
+		__m256 d1 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_unpacklo_ps(s1, s1)), _mm_unpackhi_ps(s1, s1), 1);
+
+		float *out = lr + 2*k;
+		_mm256_storeu_ps(out + 0, _mm256_add_ps(_mm256_loadu_ps(out + 0), _mm256_mul_ps(g0, d0)));
+		_mm256_storeu_ps(out + 8, _mm256_add_ps(_mm256_loadu_ps(out + 8), _mm256_mul_ps(g1, d1)));
+
+		g0 = _mm256_add_ps(g0, step);
+		g1 = _mm256_add_ps(g1, step);
+	}
+
+	mix_mono_to_stereo_scalar(src + k, count - k, lr + 2*k, l + float(k) * dl, r + float(k) * dr, dl, dr);
+}
+
+//AVX2 version: 8 frames per iteration, converting int16 -> int32 -> float as it goes.
+TARGET_AVX2 void mix_int16_mono_to_stereo_avx2(int16_t const *src, uint32_t count, float *lr, float l, float r, float dl, float dr) {
+	__m256 g0 = _mm256_setr_ps(
+		l, r, l + dl, r + dr,
+		l + 2.0f * dl, r + 2.0f * dr, l + 3.0f * dl, r + 3.0f * dr);
+	__m256 g1 = _mm256_add_ps(g0, _mm256_setr_ps(
+		4.0f * dl, 4.0f * dr, 4.0f * dl, 4.0f * dr,
+		4.0f * dl, 4.0f * dr, 4.0f * dl, 4.0f * dr));
+	__m256 step = _mm256_setr_ps(
+		8.0f * dl, 8.0f * dr, 8.0f * dl, 8.0f * dr,
+		8.0f * dl, 8.0f * dr, 8.0f * dl, 8.0f * dr);
+
+	uint32_t k = 0;
+	for (; k + 8 <= count; k += 8) {
+		__m128i i16 = _mm_loadu_si128(reinterpret_cast< __m128i const * >(src + k));
+		__m256 s = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(i16));
+		//duplicate each sample into an L and R lane (unpack works within 128-bit halves, so fix up the order after):
+		__m256 lo = _mm256_unpacklo_ps(s, s); //s0 s0 s1 s1 | s4 s4 s5 s5
+		__m256 hi = _mm256_unpackhi_ps(s, s); //s2 s2 s3 s3 | s6 s6 s7 s7
+		__m256 d0 = _mm256_permute2f128_ps(lo, hi, 0x20);
+		__m256 d1 = _mm256_permute2f128_ps(lo, hi, 0x31);
+
+		float *out = lr + 2*k;
+		_mm256_storeu_ps(out + 0, _mm256_add_ps(_mm256_loadu_ps(out + 0), _mm256_mul_ps(g0, d0)));
+		_mm256_storeu_ps(out + 8, _mm256_add_ps(_mm256_loadu_ps(out + 8), _mm256_mul_ps(g1, d1)));
+
+		g0 = _mm256_add_ps(g0, step);
+		g1 = _mm256_add_ps(g1, step);
+	}
+
+	mix_int16_mono_to_stereo_scalar(src + k, count - k, lr + 2*k, l + float(k) * dl, r + float(k) * dr, dl, dr);
+}
+
+//AVX2 version: 8 frames (two LRLRLRLR registers) per iteration.
+TARGET_AVX2 void mix_stereo_avx2(float const *src, uint32_t frames, float *lr, float gain, float dgain) {
+	__m256 g0 = _mm256_setr_ps(
+		gain, gain, gain + dgain, gain + dgain,
+		gain + 2.0f * dgain, gain + 2.0f * dgain, gain + 3.0f * dgain, gain + 3.0f * dgain);
+	__m256 g1 = _mm256_add_ps(g0, _mm256_set1_ps(4.0f * dgain));
+	__m256 step = _mm256_set1_ps(8.0f * dgain);
+
+	uint32_t k = 0;
+	for (; k + 8 <= frames; k += 8) {
+		float *out = lr + 2*k;
+		_mm256_storeu_ps(out + 0, _mm256_add_ps(_mm256_loadu_ps(out + 0), _mm256_mul_ps(g0, _mm256_loadu_ps(src + 2*k + 0))));
+		_mm256_storeu_ps(out + 8, _mm256_add_ps(_mm256_loadu_ps(out + 8), _mm256_mul_ps(g1, _mm256_loadu_ps(src + 2*k + 8))));
+		g0 = _mm256_add_ps(g0, step);
+		g1 = _mm256_add_ps(g1, step);
+	}
+
+	mix_stereo_scalar(src + 2*k, frames - k, lr + 2*k, gain + float(k) * dgain, dgain);
+}
+
+//AVX2 version: 8 sources per iteration.
+TARGET_AVX2 void pan_3d_avx2(uint32_t count, float const *x, float const *y, float const *z, float const *half_radius, float const *volume,
+	float const listener[3], float const right[3], float *left_gain, float *right_gain) {
+	__m256 lx = _mm256_set1_ps(listener[0]), ly = _mm256_set1_ps(listener[1]), lz = _mm256_set1_ps(listener[2]);
+	__m256 rx = _mm256_set1_ps(right[0]), ry = _mm256_set1_ps(right[1]), rz = _mm256_set1_ps(right[2]);
+	__m256 one = _mm256_set1_ps(1.0f);
+
+	uint32_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 tx = _mm256_sub_ps(_mm256_loadu_ps(x + i), lx);
+		__m256 ty = _mm256_sub_ps(_mm256_loadu_ps(y + i), ly);
+		__m256 tz = _mm256_sub_ps(_mm256_loadu_ps(z + i), lz);
+		__m256 distance = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(tx, tx), _mm256_mul_ps(ty, ty)), _mm256_mul_ps(tz, tz)));
+		__m256 dot = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(rx, tx), _mm256_mul_ps(ry, ty)), _mm256_mul_ps(rz, tz));
+		__m256 amt = _mm256_max_ps(_mm256_set1_ps(-1.0f), _mm256_min_ps(one, _mm256_div_ps(dot, distance)));
+
+		__m256 phi = _mm256_mul_ps(_mm256_set1_ps(QUARTER_PI), amt);
+		__m256 p2 = _mm256_mul_ps(phi, phi);
+		__m256 s = _mm256_add_ps(_mm256_set1_ps(SIN_C5), _mm256_mul_ps(p2, _mm256_set1_ps(SIN_C7)));
+		s = _mm256_add_ps(_mm256_set1_ps(SIN_C3), _mm256_mul_ps(p2, s));
+		s = _mm256_mul_ps(phi, _mm256_add_ps(one, _mm256_mul_ps(p2, s)));
+		__m256 c = _mm256_add_ps(_mm256_set1_ps(COS_C6), _mm256_mul_ps(p2, _mm256_set1_ps(COS_C8)));
+		c = _mm256_add_ps(_mm256_set1_ps(COS_C4), _mm256_mul_ps(p2, c));
+		c = _mm256_add_ps(_mm256_set1_ps(COS_C2), _mm256_mul_ps(p2, c));
+		c = _mm256_add_ps(one, _mm256_mul_ps(p2, c));
+
+		__m256 inv_radius = _mm256_div_ps(one, _mm256_loadu_ps(half_radius + i));
+		__m256 att = _mm256_div_ps(_mm256_loadu_ps(volume + i), _mm256_add_ps(one, _mm256_mul_ps(distance, inv_radius)));
+		att = _mm256_mul_ps(att, _mm256_set1_ps(SQRT_HALF));
+		__m256 l = _mm256_mul_ps(_mm256_sub_ps(c, s), att);
+		__m256 r = _mm256_mul_ps(_mm256_add_ps(c, s), att);
+
+		__m256 at_listener = _mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_EQ_OQ);
+		__m256 centered = _mm256_mul_ps(_mm256_set1_ps(1.41421356f), _mm256_loadu_ps(volume + i));
+		_mm256_storeu_ps(left_gain + i, _mm256_blendv_ps(l, centered, at_listener));
+		_mm256_storeu_ps(right_gain + i, _mm256_blendv_ps(r, centered, at_listener));
+	}
+
+	pan_3d_scalar(count - i, x + i, y + i, z + i, half_radius + i, volume + i, listener, right, left_gain + i, right_gain + i);
+}
+
+//AVX2 version: eight transforms (q) per iteration when stride >= 8; earlier passes use the SSE2 version.
+TARGET_AVX2 void fft_radix4_pass_avx2(float const *x_re, float const *x_im, float *y_re, float *y_im, uint32_t quarter, uint32_t stride, float const *w_re, float const *w_im) {
+	if (stride < 8) {
+		fft_radix4_pass_sse2(x_re, x_im, y_re, y_im, quarter, stride, w_re, w_im);
+		return;
+	}
+	uint32_t const span = stride * quarter;
+	for (uint32_t p = 0; p < quarter; ++p) {
+		__m256 w1r = _mm256_set1_ps(w_re[p]), w1i = _mm256_set1_ps(w_im[p]);
+		__m256 w2r = _mm256_set1_ps(w_re[quarter + p]), w2i = _mm256_set1_ps(w_im[quarter + p]);
+		__m256 w3r = _mm256_set1_ps(w_re[2*quarter + p]), w3i = _mm256_set1_ps(w_im[2*quarter + p]);
+		for (uint32_t q = 0; q < stride; q += 8) {
+			uint32_t i = q + stride * p;
+			uint32_t o = q + stride * 4 * p;
+			__m256 ar = _mm256_loadu_ps(x_re + i), ai = _mm256_loadu_ps(x_im + i);
+			__m256 br = _mm256_loadu_ps(x_re + i + span), bi = _mm256_loadu_ps(x_im + i + span);
+			__m256 cr = _mm256_loadu_ps(x_re + i + 2 * span), ci = _mm256_loadu_ps(x_im + i + 2 * span);
+			__m256 dr = _mm256_loadu_ps(x_re + i + 3 * span), di = _mm256_loadu_ps(x_im + i + 3 * span);
+
+			__m256 apc_r = _mm256_add_ps(ar, cr), apc_i = _mm256_add_ps(ai, ci);
+			__m256 amc_r = _mm256_sub_ps(ar, cr), amc_i = _mm256_sub_ps(ai, ci);
+			__m256 bpd_r = _mm256_add_ps(br, dr), bpd_i = _mm256_add_ps(bi, di);
+			__m256 bmd_r = _mm256_sub_ps(br, dr), bmd_i = _mm256_sub_ps(bi, di);
+
+			__m256 t1r = _mm256_add_ps(amc_r, bmd_i), t1i = _mm256_sub_ps(amc_i, bmd_r);
+			__m256 t2r = _mm256_sub_ps(apc_r, bpd_r), t2i = _mm256_sub_ps(apc_i, bpd_i);
+			__m256 t3r = _mm256_sub_ps(amc_r, bmd_i), t3i = _mm256_add_ps(amc_i, bmd_r);
+
+			_mm256_storeu_ps(y_re + o, _mm256_add_ps(apc_r, bpd_r));
+			_mm256_storeu_ps(y_im + o, _mm256_add_ps(apc_i, bpd_i));
+			_mm256_storeu_ps(y_re + o + stride, _mm256_sub_ps(_mm256_mul_ps(w1r, t1r), _mm256_mul_ps(w1i, t1i)));
+			_mm256_storeu_ps(y_im + o + stride, _mm256_add_ps(_mm256_mul_ps(w1r, t1i), _mm256_mul_ps(w1i, t1r)));
+			_mm256_storeu_ps(y_re + o + 2 * stride, _mm256_sub_ps(_mm256_mul_ps(w2r, t2r), _mm256_mul_ps(w2i, t2i)));
+			_mm256_storeu_ps(y_im + o + 2 * stride, _mm256_add_ps(_mm256_mul_ps(w2r, t2i), _mm256_mul_ps(w2i, t2r)));
+			_mm256_storeu_ps(y_re + o + 3 * stride, _mm256_sub_ps(_mm256_mul_ps(w3r, t3r), _mm256_mul_ps(w3i, t3i)));
+			_mm256_storeu_ps(y_im + o + 3 * stride, _mm256_add_ps(_mm256_mul_ps(w3r, t3i), _mm256_mul_ps(w3i, t3r)));
+		}
+	}
+}
+
+//AVX2 version: 8 bins per iteration.
+TARGET_AVX2 void complex_mac_avx2(float const *a_re, float const *a_im, float const *b_re, float const *b_im, uint32_t count, float *acc_re, float *acc_im) {
+	uint32_t k = 0;
+	for (; k + 8 <= count; k += 8) {
+		__m256 ar = _mm256_loadu_ps(a_re + k), ai = _mm256_loadu_ps(a_im + k);
+		__m256 br = _mm256_loadu_ps(b_re + k), bi = _mm256_loadu_ps(b_im + k);
+		_mm256_storeu_ps(acc_re + k, _mm256_add_ps(_mm256_loadu_ps(acc_re + k), _mm256_sub_ps(_mm256_mul_ps(ar, br), _mm256_mul_ps(ai, bi))));
+		_mm256_storeu_ps(acc_im + k, _mm256_add_ps(_mm256_loadu_ps(acc_im + k), _mm256_add_ps(_mm256_mul_ps(ar, bi), _mm256_mul_ps(ai, br))));
+	}
+	complex_mac_scalar(a_re + k, a_im + k, b_re + k, b_im + k, count - k, acc_re + k, acc_im + k);
+}
+
+//AVX2 version: 8 frames (two LRLRLRLR registers) per iteration.
+TARGET_AVX2 void downmix_stereo_avx2(float const *lr, uint32_t frames, float *mono) {
+	__m256 half = _mm256_set1_ps(0.5f);
+	uint32_t k = 0;
+	for (; k + 8 <= frames; k += 8) {
+		__m256 a = _mm256_loadu_ps(lr + 2*k + 0); //frames 0-3
+		__m256 b = _mm256_loadu_ps(lr + 2*k + 8); //frames 4-7
+		//(shuffles work within 128-bit lanes, so sums come out as frames 0 1 4 5 2 3 6 7...)
+		__m256 sum = _mm256_add_ps(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)), _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+		//(...and get put back in order here)
+		sum = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(sum), _MM_SHUFFLE(3, 1, 2, 0)));
+		_mm256_storeu_ps(mono + k, _mm256_mul_ps(sum, half));
+	}
+	downmix_stereo_scalar(lr + 2*k, frames - k, mono + k);
+}
+
+//AVX2 version: 16 products (two independent sums) per iteration.
+TARGET_AVX2 float dot_product_avx2(float const *a, float const *b, uint32_t count) {
+	__m256 sum0 = _mm256_setzero_ps();
+	__m256 sum1 = _mm256_setzero_ps();
+	uint32_t k = 0;
+	for (; k + 16 <= count; k += 16) {
+		sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(_mm256_loadu_ps(a + k), _mm256_loadu_ps(b + k)));
+		sum1 = _mm256_add_ps(sum1, _mm256_mul_ps(_mm256_loadu_ps(a + k + 8), _mm256_loadu_ps(b + k + 8)));
+	}
+	if (k + 8 <= count) {
+		sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(_mm256_loadu_ps(a + k), _mm256_loadu_ps(b + k)));
+		k += 8;
+	}
+	//horizontal sum:
+	sum0 = _mm256_add_ps(sum0, sum1);
+	__m128 sum = _mm_add_ps(_mm256_castps256_ps128(sum0), _mm256_extractf128_ps(sum0, 1));
+	sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+	sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+	return _mm_cvtss_f32(sum) + dot_product_scalar(a + k, b + k, count - k);
+}
+
+//AVX2 helper: playhead positions for outputs k through k+7 (fk holds them as floats), split into whole and fractional parts:
+TARGET_AVX2 inline __m256i playheads_avx2(__m256 fk, __m256 pos, __m256 rate, __m256 drate, __m256 *t) {
+	__m256 tri = _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(0.5f), fk), _mm256_sub_ps(fk, _mm256_set1_ps(1.0f)));
+	__m256 p = _mm256_add_ps(_mm256_add_ps(pos, _mm256_mul_ps(fk, rate)), _mm256_mul_ps(tri, drate));
+	__m256i whole = _mm256_cvttps_epi32(p);
+	*t = _mm256_sub_ps(p, _mm256_cvtepi32_ps(whole));
+	return whole;
+}
+
+//AVX2 version: 8 outputs per iteration, with gathers.
+TARGET_AVX2 void interpolate_linear_avx2(float const *src, uint32_t count, float pos, float rate, float drate, float *out) {
+	__m256 vpos = _mm256_set1_ps(pos), vrate = _mm256_set1_ps(rate), vdrate = _mm256_set1_ps(drate);
+	__m256 fk = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+	uint32_t k = 0;
+	for (; k + 8 <= count; k += 8) {
+		__m256 t;
+		__m256i n = playheads_avx2(fk, vpos, vrate, vdrate, &t);
+		__m256 b = _mm256_i32gather_ps(src, n, 4);
+		__m256 c = _mm256_i32gather_ps(src + 1, n, 4);
+		_mm256_storeu_ps(out + k, _mm256_add_ps(b, _mm256_mul_ps(t, _mm256_sub_ps(c, b))));
+		fk = _mm256_add_ps(fk, _mm256_set1_ps(8.0f));
+	}
+	interpolate_linear_from(k, src, count, pos, rate, drate, out);
+}
+
+TARGET_AVX2 void interpolate_cubic_avx2(float const *src, uint32_t count, float pos, float rate, float drate, float *out) {
+	__m256 vpos = _mm256_set1_ps(pos), vrate = _mm256_set1_ps(rate), vdrate = _mm256_set1_ps(drate);
+	__m256 fk = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+	__m256 half = _mm256_set1_ps(0.5f), two = _mm256_set1_ps(2.0f), three = _mm256_set1_ps(3.0f), four = _mm256_set1_ps(4.0f), five = _mm256_set1_ps(5.0f);
+	uint32_t k = 0;
+	for (; k + 8 <= count; k += 8) {
+		__m256 t;
+		__m256i n = playheads_avx2(fk, vpos, vrate, vdrate, &t);
+		__m256 a = _mm256_i32gather_ps(src - 1, n, 4);
+		__m256 b = _mm256_i32gather_ps(src, n, 4);
+		__m256 c = _mm256_i32gather_ps(src + 1, n, 4);
+		__m256 d = _mm256_i32gather_ps(src + 2, n, 4);
+		__m256 c3 = _mm256_add_ps(_mm256_mul_ps(three, _mm256_sub_ps(b, c)), _mm256_sub_ps(d, a));
+		__m256 c2 = _mm256_sub_ps(_mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(two, a), _mm256_mul_ps(five, b)), _mm256_mul_ps(four, c)), d);
+		__m256 poly = _mm256_add_ps(_mm256_sub_ps(c, a), _mm256_mul_ps(t, _mm256_add_ps(c2, _mm256_mul_ps(t, c3))));
+		_mm256_storeu_ps(out + k, _mm256_add_ps(b, _mm256_mul_ps(_mm256_mul_ps(half, t), poly)));
+		fk = _mm256_add_ps(fk, _mm256_set1_ps(8.0f));
+	}
+	interpolate_cubic_from(k, src, count, pos, rate, drate, out);
+}
+
+#endif //MIX_KERNELS_X86
+
+struct Kernels {
+	char const *name;
+	void (*mix_mono_to_stereo)(float const *, uint32_t, float *, float, float, float, float);
+	void (*mix_int16_mono_to_stereo)(int16_t const *, uint32_t, float *, float, float, float, float);
+	void (*mix_stereo)(float const *, uint32_t, float *, float, float);
+	void (*one_pole_stereo)(float *, uint32_t, float, float[2]);
+	void (*pan_3d)(uint32_t, float const *, float const *, float const *, float const *, float const *, float const[3], float const[3], float *, float *);
+	void (*fft_radix4_pass)(float const *, float const *, float *, float *, uint32_t, uint32_t, float const *, float const *);
+	void (*complex_mac)(float const *, float const *, float const *, float const *, uint32_t, float *, float *);
+	void (*downmix_stereo)(float const *, uint32_t, float *);
+	float (*dot_product)(float const *, float const *, uint32_t);
+	void (*interpolate_linear)(float const *, uint32_t, float, float, float, float *);
+	void (*interpolate_cubic)(float const *, uint32_t, float, float, float, float *);
+};
+
+Kernels choose_kernels() {
+	#ifdef MIX_KERNELS_X86
+	if (SDL_HasAVX2()) {
+		return Kernels{ "avx2", mix_mono_to_stereo_avx2, mix_int16_mono_to_stereo_avx2, mix_stereo_avx2, one_pole_stereo_sse2, pan_3d_avx2, fft_radix4_pass_avx2, complex_mac_avx2, downmix_stereo_avx2, dot_product_avx2, interpolate_linear_avx2, interpolate_cubic_avx2 };
+	}
+	if (SDL_HasSSE2()) {
+		return Kernels{ "sse2", mix_mono_to_stereo_sse2, mix_int16_mono_to_stereo_sse2, mix_stereo_sse2, one_pole_stereo_sse2, pan_3d_sse2, fft_radix4_pass_sse2, complex_mac_sse2, downmix_stereo_sse2, dot_product_sse2, interpolate_linear_sse2, interpolate_cubic_sse2 };
+	}
+	#endif
+	return Kernels{ "scalar", mix_mono_to_stereo_scalar, mix_int16_mono_to_stereo_scalar, mix_stereo_scalar, one_pole_stereo_scalar, pan_3d_scalar, fft_radix4_pass_scalar, complex_mac_scalar, downmix_stereo_scalar, dot_product_scalar, interpolate_linear_scalar, interpolate_cubic_scalar };
+}
+
+//chosen during static initialization, so well before the audio callback first runs:
+Kernels const kernels = choose_kernels();
+
+}
+
+void mix_mono_to_stereo(float const *src, uint32_t count, float *lr, float l, float r, float dl, float dr) {
+	kernels.mix_mono_to_stereo(src, count, lr, l, r, dl, dr);
+}
+
+void mix_int16_mono_to_stereo(int16_t const *src, uint32_t count, float *lr, float l, float r, float dl, float dr) {
+	kernels.mix_int16_mono_to_stereo(src, count, lr, l, r, dl, dr);
+}
+
+void mix_stereo(float const *src, uint32_t frames, float *lr, float gain, float dgain) {
+	kernels.mix_stereo(src, frames, lr, gain, dgain);
+}
+
+void one_pole_stereo(float *lr, uint32_t frames, float a, float state[2]) {
+	kernels.one_pole_stereo(lr, frames, a, state);
+}
+
+void pan_3d(uint32_t count, float const *x, float const *y, float const *z, float const *half_radius, float const *volume,
+	float const listener[3], float const right[3], float *left_gain, float *right_gain) {
+	kernels.pan_3d(count, x, y, z, half_radius, volume, listener, right, left_gain, right_gain);
+}
+
+void fft_radix4_pass(float const *x_re, float const *x_im, float *y_re, float *y_im, uint32_t quarter, uint32_t stride, float const *w_re, float const *w_im) {
+	kernels.fft_radix4_pass(x_re, x_im, y_re, y_im, quarter, stride, w_re, w_im);
+}
+
+void complex_mac(float const *a_re, float const *a_im, float const *b_re, float const *b_im, uint32_t count, float *acc_re, float *acc_im) {
+	kernels.complex_mac(a_re, a_im, b_re, b_im, count, acc_re, acc_im);
+}
+
+void downmix_stereo(float const *lr, uint32_t frames, float *mono) {
+	kernels.downmix_stereo(lr, frames, mono);
+}
+
+float dot_product(float const *a, float const *b, uint32_t count) {
+	return kernels.dot_product(a, b, count);
+}
+
+void interpolate_linear(float const *src, uint32_t count, float pos, float rate, float drate, float *out) {
+	kernels.interpolate_linear(src, count, pos, rate, drate, out);
+}
+
+void interpolate_cubic(float const *src, uint32_t count, float pos, float rate, float drate, float *out) {
+	kernels.interpolate_cubic(src, count, pos, rate, drate, out);
+}
+
+char const *mix_kernel_name() {
+	return kernels.name;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+
+//Block mixing kernels used by Sound's mix_audio callback.
+//The best available implementation (AVX2, SSE2, or plain scalar code) is
+// picked once, at startup, based on what the CPU reports it supports.
+
+//Accumulate 'count' mono samples from 'src' into the interleaved stereo buffer 'lr',
+// scaling frame k by gains (l + k * dl, r + k * dr):
+//  lr[2k+0] += (l + k * dl) * src[k]
+//  lr[2k+1] += (r + k * dr) * src[k]
+void mix_mono_to_stereo(float const *src, uint32_t count, float *lr, float l, float r, float dl, float dr);
+
+//Same, but for 16-bit integer source data (converted to float on the fly; gains should include any 1/32768 scaling):
+void mix_int16_mono_to_stereo(int16_t const *src, uint32_t count, float *lr, float l, float r, float dl, float dr);
+
+//Accumulate 'frames' interleaved stereo frames from 'src' into 'lr', scaling frame k by gain + k * dgain:
+//  lr[2k+c] += (gain + k * dgain) * src[2k+c]
+void mix_stereo(float const *src, uint32_t frames, float *lr, float gain, float dgain);
+
+//One-pole low-pass filter over 'frames' interleaved stereo frames, in place:
+//  state[c] += a * (lr[2k+c] - state[c]); lr[2k+c] = state[c]
+// (the recurrence is serial in time, so the vector versions filter both channels at once)
+void one_pole_stereo(float *lr, uint32_t frames, float a, float state[2]);
+
+//Average 'frames' interleaved stereo frames down to mono:
+//  mono[k] = 0.5 * (lr[2k+0] + lr[2k+1])
+void downmix_stereo(float const *lr, uint32_t frames, float *mono);
+
+//Sum of a[k] * b[k] over 'count' elements (e.g., one output of a FIR filter):
+float dot_product(float const *a, float const *b, uint32_t count);
+
+//3D panning gains for 'count' sources, given as structure-of-arrays positions (x, y, z), half-volume radii, and volumes,
+// heard by a listener at 'listener' whose right-hand direction is the unit vector 'right':
+//  equal-power left/right split by direction, times volume / (1 + distance / half_radius)
+// (sin/cos are approximated by polynomials, accurate to ~3e-7; gains go to left_gain[i], right_gain[i])
+void pan_3d(uint32_t count, float const *x, float const *y, float const *z, float const *half_radius, float const *volume,
+	float const listener[3], float const right[3], float *left_gain, float *right_gain);
+
+//One radix-4 pass of a Stockham FFT (see FFT.hpp) over split complex data, from x to y (which must not overlap):
+//  for p < quarter, q < stride, with a, b, c, d = x[q + stride * (p + k * quarter)] for k = 0, 1, 2, 3:
+//   y[q + stride * (4p + 0)] = (a + c) + (b + d)
+//   y[q + stride * (4p + 1)] = w1[p] * ((a - c) - i(b - d))
+//   y[q + stride * (4p + 2)] = w2[p] * ((a + c) - (b + d))
+//   y[q + stride * (4p + 3)] = w3[p] * ((a - c) + i(b - d))
+// where twiddle wk[p] is (w_re, w_im)[(k-1) * quarter + p]; 'stride' and 'quarter' are powers of four.
+void fft_radix4_pass(float const *x_re, float const *x_im, float *y_re, float *y_im, uint32_t quarter, uint32_t stride, float const *w_re, float const *w_im);
+
+//Complex multiply-accumulate over 'count' elements of split complex arrays:
+//  acc[k] += a[k] * b[k]
+void complex_mac(float const *a_re, float const *a_im, float const *b_re, float const *b_im, uint32_t count, float *acc_re, float *acc_im);
+
+//Read 'count' values from 'src' at fractional positions (variable-rate playback), with the playhead starting at 'pos'
+// and moving 'rate' (plus 'drate' more each output) per output:
+//  p = pos + k * rate + k * (k - 1) / 2 * drate; out[k] = src interpolated at p
+// linear interpolation reads src[floor(p)] and src[floor(p) + 1];
+// cubic (Catmull-Rom) interpolation also reads src[floor(p) - 1] and src[floor(p) + 2], so needs pos >= 1:
+void interpolate_linear(float const *src, uint32_t count, float pos, float rate, float drate, float *out);
+void interpolate_cubic(float const *src, uint32_t count, float pos, float rate, float drate, float *out);
+
+//Name of the kernel variant in use (handy for logging / benchmarks):
+char const *mix_kernel_name();
@@ -0,0 +1,57 @@
+//pack-samples: decode a set of '.wav' / '.opus' files into a single SampleBank file.
+//
+//Each sample is named after its file, without directory or extension
+// (e.g., 'audio/left.opus' becomes 'left').
+
+#include "Sound.hpp"
+#include "SampleBank.hpp"
+
+#include <SDL.h>
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+	//when compiled on windows, unhandled exceptions don't have their message printed, which can make debugging simple issues difficult.
+	try {
+#endif
+
+	if (argc < 3) {
+		std::cerr << "Usage:\n\t" << argv[0] << " <out.bank> <in.wav|in.opus> [...]" << std::endl;
+		return 1;
+	}
+
+	std::vector< std::unique_ptr< Sound::Sample > > loaded;
+	std::vector< std::pair< std::string, Sound::Sample const * > > samples;
+	for (int i = 2; i < argc; ++i) {
+		std::string path = argv[i];
+		std::string name = path.substr(path.find_last_of("/\\") + 1);
+		name = name.substr(0, name.rfind('.'));
+
+		loaded.emplace_back(std::make_unique< Sound::Sample >(path));
+		samples.emplace_back(name, loaded.back().get());
+	}
+
+	SampleBank::write(argv[1], samples);
+
+	size_t total = 0;
+	for (auto const &sample : loaded) {
+		total += sample->sample_count();
+	}
+	std::cout << "Wrote " << samples.size() << " samples (" << total / 48000.0f << " seconds) to '" << argv[1] << "'." << std::endl;
+
+	return 0;
+
+#ifdef _WIN32
+	} catch (std::exception const &e) {
+		std::cerr << "Unhandled exception:\n" << e.what() << std::endl;
+		return 1;
+	} catch (...) {
+		std::cerr << "Unhandled exception (unknown type)." << std::endl;
+		throw;
+	}
+#endif
+}
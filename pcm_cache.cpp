@@ -0,0 +1,82 @@
+#include "pcm_cache.hpp"
+#include "read_write_chunk.hpp"
+
+#include <cassert>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+
+//bump when the decoders change in a way that changes their output:
+// 2: load_wav resamples with Resampler (instead of SDL_AudioCVT) and downmixes itself
+constexpr uint32_t CACHE_VERSION = 2;
+
+//header stored in the cache file's "pcm0" chunk:
+struct CacheInfo {
+	uint32_t version;
+	uint32_t rate; //always 48000 (in case that ever changes)
+	uint64_t source_size; //size of the source file in bytes
+	uint64_t source_hash; //FNV-1a hash of the source file's contents
+};
+static_assert(sizeof(CacheInfo) == 24, "CacheInfo is packed.");
+
+//read a whole file and fill in its size and hash; throws on error:
+static void hash_file(std::string const &filename, CacheInfo *info) {
+	std::ifstream file(filename, std::ios::binary);
+	if (!file) throw std::runtime_error("Failed to open '" + filename + "'.");
+	std::vector< char > bytes((std::istreambuf_iterator< char >(file)), std::istreambuf_iterator< char >());
+
+	//64-bit FNV-1a:
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (char c : bytes) {
+		hash ^= uint8_t(c);
+		hash *= 0x100000001b3ULL;
+	}
+
+	info->version = CACHE_VERSION;
+	info->rate = 48000;
+	info->source_size = bytes.size();
+	info->source_hash = hash;
+}
+
+void load_pcm_cached(std::string const &filename, std::vector< float > *data_, void (*decode)(std::string const &, std::vector< float > *)) {
+	assert(data_);
+	assert(decode);
+	auto &data = *data_;
+
+	std::string cache_filename = filename + ".pcm";
+
+	CacheInfo source;
+	hash_file(filename, &source);
+
+	//try the cache:
+	try {
+		std::ifstream file(cache_filename, std::ios::binary);
+		if (file) {
+			std::vector< CacheInfo > cached;
+			read_chunk(file, "pcm0", &cached);
+			if (cached.size() == 1
+			 && cached[0].version == source.version
+			 && cached[0].rate == source.rate
+			 && cached[0].source_size == source.source_size
+			 && cached[0].source_hash == source.source_hash) {
+				read_chunk(file, "f32m", &data);
+				return;
+			}
+		}
+	} catch (std::exception &e) {
+		std::cerr << "WARNING: ignoring unreadable audio cache '" << cache_filename << "' (" << e.what() << ")." << std::endl;
+	}
+
+	//cache miss; decode and refresh cache:
+	decode(filename, &data);
+
+	std::ofstream file(cache_filename, std::ios::binary);
+	std::vector< CacheInfo > info{ source };
+	write_chunk("pcm0", info, &file);
+	write_chunk("f32m", data, &file);
+	if (!file) {
+		std::cerr << "WARNING: failed to write audio cache '" << cache_filename << "'." << std::endl;
+	}
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+//On-disk cache of decoded audio.
+//
+//Decoded (48kHz, mono, float) data for 'filename' is kept in 'filename.pcm', tagged with a hash
+// of the source file's contents. If the cache matches the source, data is filled by one bulk read;
+// otherwise 'decode' is called to fill data and the cache is (re-)written.
+//Failing to write the cache (e.g., read-only install directory) is only a warning.
+void load_pcm_cached(
+	std::string const &filename,
+	std::vector< float > *data,
+	void (*decode)(std::string const &filename, std::vector< float > *data) //e.g., load_wav or load_opus
+);
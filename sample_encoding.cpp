@@ -0,0 +1,94 @@
+#include "sample_encoding.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+//IMA ADPCM tables:
+static int16_t const step_table[89] = {
+	7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+	50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+	253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+	1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+	3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487,
+	12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+static int8_t const index_table[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+
+static int16_t to_int16(float value) {
+	return int16_t(std::lround(std::max(-1.0f, std::min(1.0f, value)) * 32767.0f));
+}
+
+//apply one 4-bit code to the decoder state (shared by the encoder so the two stay in step):
+static inline void step_adpcm(uint8_t code, int32_t *predictor, int32_t *index) {
+	int32_t step = step_table[*index];
+	int32_t diff = step >> 3;
+	if (code & 1) diff += step >> 2;
+	if (code & 2) diff += step >> 1;
+	if (code & 4) diff += step;
+	if (code & 8) *predictor -= diff;
+	else *predictor += diff;
+	*predictor = std::max(-32768, std::min(32767, *predictor));
+	*index = std::max(0, std::min(88, *index + index_table[code & 7]));
+}
+
+void encode_int16(float const *data, uint32_t count, std::vector< int16_t > *out_) {
+	assert(out_);
+	auto &out = *out_;
+	out.resize(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		out[i] = to_int16(data[i]);
+	}
+}
+
+void encode_adpcm(float const *data, uint32_t count, std::vector< uint8_t > *out_) {
+	assert(out_);
+	auto &out = *out_;
+	uint32_t blocks = (count + ADPCM_BLOCK_SAMPLES - 1) / ADPCM_BLOCK_SAMPLES;
+	out.assign(size_t(blocks) * ADPCM_BLOCK_BYTES, 0);
+
+	int32_t index = 0; //step index carries over between blocks, so each block starts well-adapted
+	for (uint32_t b = 0; b < blocks; ++b) {
+		uint8_t *block = out.data() + size_t(b) * ADPCM_BLOCK_BYTES;
+		auto sample = [&](uint32_t k) {
+			uint32_t i = b * ADPCM_BLOCK_SAMPLES + k;
+			return (i < count ? to_int16(data[i]) : int16_t(0));
+		};
+
+		int32_t predictor = sample(0);
+		uint16_t first = uint16_t(int16_t(predictor));
+		block[0] = uint8_t(first & 0xff);
+		block[1] = uint8_t(first >> 8);
+		block[2] = uint8_t(index);
+
+		for (uint32_t k = 1; k < ADPCM_BLOCK_SAMPLES; ++k) {
+			//pick the code that best approximates the difference from the decoder's prediction:
+			int32_t diff = int32_t(sample(k)) - predictor;
+			int32_t step = step_table[index];
+			uint8_t code = 0;
+			if (diff < 0) {
+				code = 8;
+				diff = -diff;
+			}
+			if (diff >= step) { code |= 4; diff -= step; }
+			step >>= 1;
+			if (diff >= step) { code |= 2; diff -= step; }
+			step >>= 1;
+			if (diff >= step) { code |= 1; }
+
+			step_adpcm(code, &predictor, &index);
+			block[4 + (k-1) / 2] |= uint8_t(((k-1) & 1) ? (code << 4) : code);
+		}
+	}
+}
+
+void decode_adpcm_block(uint8_t const *block, int16_t *out) {
+	int32_t predictor = int16_t(uint16_t(block[0]) | (uint16_t(block[1]) << 8));
+	int32_t index = std::min< int32_t >(88, block[2]);
+	out[0] = int16_t(predictor);
+	for (uint32_t k = 1; k < ADPCM_BLOCK_SAMPLES; ++k) {
+		uint8_t byte = block[4 + (k-1) / 2];
+		step_adpcm(((k-1) & 1) ? (byte >> 4) : (byte & 0xf), &predictor, &index);
+		out[k] = int16_t(predictor);
+	}
+}
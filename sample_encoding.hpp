@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+//Compact encodings for in-memory sample data (see Sound::Sample::Storage).
+//
+//Int16: plain 16-bit PCM (value * 32767, clamped).
+//
+//ADPCM: IMA-style 4-bit ADPCM, in independently decodable blocks of ADPCM_BLOCK_SAMPLES samples:
+// |pr|ed| <-- int16 first sample of the block
+// |ix|..| <-- uint8 step table index, uint8 padding
+// |nn|nn|... <-- (ADPCM_BLOCK_SAMPLES-1) 4-bit codes, low nibble first
+//Blocks let the mixer start decoding anywhere in a sample (e.g., after a loop or a virtual voice skipping ahead).
+
+constexpr uint32_t const ADPCM_BLOCK_SAMPLES = 64;
+constexpr uint32_t const ADPCM_BLOCK_BYTES = 4 + ADPCM_BLOCK_SAMPLES / 2;
+
+//encode 'count' float samples (in [-1,1]) as 16-bit PCM:
+void encode_int16(float const *data, uint32_t count, std::vector< int16_t > *out);
+
+//encode 'count' float samples (in [-1,1]) as ADPCM blocks (the last block is padded with silence):
+void encode_adpcm(float const *data, uint32_t count, std::vector< uint8_t > *out);
+
+//decode one ADPCM block (ADPCM_BLOCK_BYTES bytes) into ADPCM_BLOCK_SAMPLES 16-bit samples:
+// (audio-thread safe: doesn't allocate)
+void decode_adpcm_block(uint8_t const *block, int16_t *out);
@@ -0,0 +1,129 @@
+//scene-bench: measures the cost of updating world matrices for large transform hierarchies.
+//
+//Builds a synthetic hierarchy (or loads a scene file), packs it, and times full world-matrix
+// rebuilds with one thread and then with increasing numbers of worker threads.
+
+#include "Scene.hpp"
+#include "WorkerPool.hpp"
+#include "transform_kernels.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+	//when compiled on windows, unhandled exceptions don't have their message printed, which can make debugging simple issues difficult.
+	try {
+#endif
+
+	//------------ command line ------------
+	uint32_t count = 100000; //transforms in the synthetic hierarchy
+	uint32_t branching = 8; //children per transform in the synthetic hierarchy
+	std::string scene_file = ""; //if set, load this scene instead
+	uint32_t max_threads = WorkerPool::default_workers() + 1;
+	float seconds = 0.5f; //time to spend per measurement
+
+	bool usage = false;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--transforms" && i + 1 < argc) {
+			count = uint32_t(std::stoul(argv[++i]));
+		} else if (arg == "--branching" && i + 1 < argc) {
+			branching = uint32_t(std::stoul(argv[++i]));
+		} else if (arg == "--scene" && i + 1 < argc) {
+			scene_file = argv[++i];
+		} else if (arg == "--threads" && i + 1 < argc) {
+			max_threads = uint32_t(std::stoul(argv[++i]));
+		} else if (arg == "--seconds" && i + 1 < argc) {
+			seconds = std::stof(argv[++i]);
+		} else {
+			usage = true;
+		}
+	}
+	if (usage || count == 0 || branching == 0 || max_threads == 0 || !(seconds > 0.0f)) {
+		std::cerr << "Usage:\n\t" << argv[0] << " [--transforms <count, default 100000>] [--branching <children per transform, default 8>] [--scene <file.scene>] [--threads <max, default all cores>] [--seconds <per test, default 0.5>]" << std::endl;
+		return 1;
+	}
+
+	//------------ hierarchy ------------
+	Scene scene;
+	if (scene_file != "") {
+		scene.load(scene_file);
+		std::cout << "Loaded " << scene.transforms.size() << " transforms from '" << scene_file << "'." << std::endl;
+	} else {
+		//complete 'branching'-ary tree with random transformations:
+		std::mt19937 mt(0x15466);
+		std::uniform_real_distribution< float > dist(-1.0f, 1.0f);
+		std::vector< Scene::Transform * > made;
+		made.reserve(count);
+		for (uint32_t i = 0; i < count; ++i) {
+			scene.transforms.emplace_back();
+			Scene::Transform &t = scene.transforms.back();
+			t.set_position(glm::vec3(dist(mt), dist(mt), dist(mt)));
+			t.set_rotation(glm::normalize(glm::quat(dist(mt), dist(mt), dist(mt), dist(mt))));
+			t.set_scale(glm::vec3(1.0f + 0.1f * dist(mt)));
+			if (i > 0) t.set_parent(made[(i - 1) / branching]);
+			made.emplace_back(&t);
+		}
+		std::cout << "Built " << count << " transforms, " << branching << " children each." << std::endl;
+	}
+
+	scene.pack_transforms();
+	Scene::TransformArrays &arrays = *scene.transform_arrays;
+	uint32_t largest = 0;
+	for (uint32_t l = 0; l < arrays.levels.size(); ++l) {
+		uint32_t end = (l + 1 < arrays.levels.size() ? arrays.levels[l+1] : uint32_t(arrays.transforms.size()));
+		largest = std::max(largest, end - arrays.levels[l]);
+	}
+	std::cout << arrays.levels.size() << " depth levels, largest has " << largest << " transforms. Transform kernel: " << transform_kernel_name() << "." << std::endl;
+
+	//------------ measurements ------------
+	//time full rebuilds (as after moving every root) with the given pool:
+	auto measure = [&](WorkerPool *pool) {
+		uint32_t updates = 0;
+		auto before = std::chrono::high_resolution_clock::now();
+		auto after = before;
+		do {
+			arrays.dirty_begin = 0;
+			arrays.update(pool);
+			++updates;
+			after = std::chrono::high_resolution_clock::now();
+		} while (std::chrono::duration< float >(after - before).count() < seconds);
+		return std::chrono::duration< double, std::micro >(after - before).count() / updates;
+	};
+
+	std::cout << std::fixed << std::setprecision(1);
+	std::cout << "\n  threads   us/update   ns/transform   speedup\n";
+	double one = 0.0;
+	for (uint32_t threads = 1; threads <= max_threads; ++threads) {
+		double us;
+		if (threads == 1) {
+			us = measure(nullptr);
+			one = us;
+		} else {
+			WorkerPool pool(threads - 1);
+			us = measure(&pool);
+		}
+		std::cout << "  " << std::setw(7) << threads
+			<< "  " << std::setw(10) << us
+			<< "  " << std::setw(13) << us * 1000.0 / arrays.transforms.size()
+			<< "  " << std::setw(8) << std::setprecision(2) << one / us << "x" << std::setprecision(1)
+			<< std::endl;
+	}
+
+	return 0;
+
+#ifdef _WIN32
+	} catch (std::exception const &e) {
+		std::cerr << "Unhandled exception:\n" << e.what() << std::endl;
+		return 1;
+	} catch (...) {
+		std::cerr << "Unhandled exception (unknown type)." << std::endl;
+		throw;
+	}
+#endif
+}
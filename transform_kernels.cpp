@@ -0,0 +1,303 @@
+#include "transform_kernels.hpp"
+
+#include <SDL.h>
+
+#include <cmath>
+
+//x86 targets get SSE2 (always) and AVX2 (if the CPU has it) variants:
+#if defined(__x86_64__) || defined(_M_X64) || ((defined(__i386__) || defined(_M_IX86)) && (defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)))
+#define TRANSFORM_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+//gcc/clang need to be told which functions may use AVX2 instructions; MSVC doesn't:
+#if defined(TRANSFORM_KERNELS_X86) && (defined(__GNUC__) || defined(__clang__))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+namespace {
+
+//The twelve values of a local-to-parent matrix are computed in the same order (and with the same operations)
+// by every variant, as in glm::mat3_cast, so all variants agree exactly.
+
+//local-to-parent matrix of transform i, as 12 values 'step' apart:
+inline void local_to_parent_scalar(TransformSoA const &soa, uint32_t i, float *m, uint32_t step) {
+	float x = soa.rotation[0][i], y = soa.rotation[1][i], z = soa.rotation[2][i], w = soa.rotation[3][i];
+	float sx = soa.scale[0][i], sy = soa.scale[1][i], sz = soa.scale[2][i];
+	float xx = x * x, yy = y * y, zz = z * z;
+	float xy = x * y, xz = x * z, yz = y * z;
+	float wx = w * x, wy = w * y, wz = w * z;
+	m[0*step] = (1.0f - 2.0f * (yy + zz)) * sx;
+	m[1*step] = (2.0f * (xy + wz)) * sx;
+	m[2*step] = (2.0f * (xz - wy)) * sx;
+	m[3*step] = (2.0f * (xy - wz)) * sy;
+	m[4*step] = (1.0f - 2.0f * (xx + zz)) * sy;
+	m[5*step] = (2.0f * (yz + wx)) * sy;
+	m[6*step] = (2.0f * (xz + wy)) * sz;
+	m[7*step] = (2.0f * (yz - wx)) * sz;
+	m[8*step] = (1.0f - 2.0f * (xx + yy)) * sz;
+	m[9*step] = soa.position[0][i];
+	m[10*step] = soa.position[1][i];
+	m[11*step] = soa.position[2][i];
+}
+
+//world matrix of a root transform is just its local matrix:
+inline void store_root(float const *m, uint32_t step, float *dst) {
+	for (uint32_t c = 0; c < 12; ++c) {
+		dst[c] = m[c*step];
+	}
+}
+
+//dst = P * m, treating both as 3x4 affine matrices (m given as 12 values 'step' apart):
+inline void compose_scalar(float const *P, float const *m, uint32_t step, float *dst) {
+	for (uint32_t j = 0; j < 4; ++j) {
+		float x = m[(3*j+0)*step], y = m[(3*j+1)*step], z = m[(3*j+2)*step];
+		for (uint32_t r = 0; r < 3; ++r) {
+			float v = (P[0+r] * x + P[3+r] * y) + P[6+r] * z;
+			if (j == 3) v += P[9+r];
+			dst[3*j+r] = v;
+		}
+	}
+}
+
+void build_local_to_world_scalar(TransformSoA const &soa, uint32_t begin, uint32_t end, float *local_to_world) {
+	for (uint32_t i = begin; i < end; ++i) {
+		float m[12];
+		local_to_parent_scalar(soa, i, m, 1);
+		if (soa.parent[i] == -1U) {
+			store_root(m, 1, local_to_world + 12 * i);
+		} else {
+			compose_scalar(local_to_world + 12 * soa.parent[i], m, 1, local_to_world + 12 * i);
+		}
+	}
+}
+
+//box i is outside a plane if even its corner furthest along the plane's normal is behind it:
+// (every variant computes (n.c + d) + |n|.e in this order)
+void cull_boxes_scalar(uint32_t count, float const *cx, float const *cy, float const *cz, float const *ex, float const *ey, float const *ez,
+	float const planes[24], uint8_t *visible) {
+	for (uint32_t i = 0; i < count; ++i) {
+		uint8_t inside = 1;
+		for (uint32_t p = 0; p < 6; ++p) {
+			float const *plane = planes + 4 * p;
+			float dist = ((plane[0] * cx[i] + plane[1] * cy[i]) + plane[2] * cz[i]) + plane[3];
+			float radius = (std::abs(plane[0]) * ex[i] + std::abs(plane[1]) * ey[i]) + std::abs(plane[2]) * ez[i];
+			if (!(dist + radius >= 0.0f)) inside = 0;
+		}
+		visible[i] = inside;
+	}
+}
+
+#ifdef TRANSFORM_KERNELS_X86
+
+//dst = P * m, with each column of P in one register:
+// (loads and stores are 4 wide; the extra lane of each overlaps the next column, which is written after it)
+inline void compose_sse2(float const *P, float const *m, uint32_t step, float *dst) {
+	__m128 p0 = _mm_loadu_ps(P + 0);
+	__m128 p1 = _mm_loadu_ps(P + 3);
+	__m128 p2 = _mm_loadu_ps(P + 6);
+	__m128 p3 = _mm_loadu_ps(P + 8);
+	p3 = _mm_shuffle_ps(p3, p3, _MM_SHUFFLE(3,3,2,1));
+
+	__m128 c[4];
+	for (uint32_t j = 0; j < 4; ++j) {
+		__m128 x = _mm_set1_ps(m[(3*j+0)*step]);
+		__m128 y = _mm_set1_ps(m[(3*j+1)*step]);
+		__m128 z = _mm_set1_ps(m[(3*j+2)*step]);
+		c[j] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(p0, x), _mm_mul_ps(p1, y)), _mm_mul_ps(p2, z));
+	}
+	c[3] = _mm_add_ps(c[3], p3);
+
+	_mm_storeu_ps(dst + 0, c[0]);
+	_mm_storeu_ps(dst + 3, c[1]);
+	_mm_storeu_ps(dst + 6, c[2]);
+	//last column packed as (c[2].z, c[3].x, c[3].y, c[3].z) so the store stays inside the matrix:
+	__m128 t = _mm_shuffle_ps(c[2], c[3], _MM_SHUFFLE(0,0,2,2));
+	_mm_storeu_ps(dst + 8, _mm_shuffle_ps(t, c[3], _MM_SHUFFLE(2,1,2,0)));
+}
+
+//local matrices of a block of transforms, one lane per transform, as in local_to_parent_scalar:
+// (written as 12 rows of lane values)
+void local_to_parent_sse2(TransformSoA const &soa, uint32_t i, float *block) {
+	__m128 x = _mm_loadu_ps(soa.rotation[0] + i);
+	__m128 y = _mm_loadu_ps(soa.rotation[1] + i);
+	__m128 z = _mm_loadu_ps(soa.rotation[2] + i);
+	__m128 w = _mm_loadu_ps(soa.rotation[3] + i);
+	__m128 sx = _mm_loadu_ps(soa.scale[0] + i);
+	__m128 sy = _mm_loadu_ps(soa.scale[1] + i);
+	__m128 sz = _mm_loadu_ps(soa.scale[2] + i);
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 two = _mm_set1_ps(2.0f);
+
+	__m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+	__m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+	__m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+	_mm_store_ps(block + 0*4, _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx));
+	_mm_store_ps(block + 1*4, _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx));
+	_mm_store_ps(block + 2*4, _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx));
+	_mm_store_ps(block + 3*4, _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy));
+	_mm_store_ps(block + 4*4, _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy));
+	_mm_store_ps(block + 5*4, _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy));
+	_mm_store_ps(block + 6*4, _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz));
+	_mm_store_ps(block + 7*4, _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz));
+	_mm_store_ps(block + 8*4, _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz));
+	_mm_store_ps(block + 9*4, _mm_loadu_ps(soa.position[0] + i));
+	_mm_store_ps(block + 10*4, _mm_loadu_ps(soa.position[1] + i));
+	_mm_store_ps(block + 11*4, _mm_loadu_ps(soa.position[2] + i));
+}
+
+//local matrices are built four at a time, then composed with their parents in order
+// (a transform's parent may be in the same block, so composition stays serial):
+void build_local_to_world_sse2(TransformSoA const &soa, uint32_t begin, uint32_t end, float *local_to_world) {
+	uint32_t i = begin;
+	alignas(16) float block[12 * 4];
+	for (; i + 4 <= end; i += 4) {
+		local_to_parent_sse2(soa, i, block);
+		for (uint32_t l = 0; l < 4; ++l) {
+			if (soa.parent[i+l] == -1U) {
+				store_root(block + l, 4, local_to_world + 12 * (i+l));
+			} else {
+				compose_sse2(local_to_world + 12 * soa.parent[i+l], block + l, 4, local_to_world + 12 * (i+l));
+			}
+		}
+	}
+	for (; i < end; ++i) {
+		float m[12];
+		local_to_parent_scalar(soa, i, m, 1);
+		if (soa.parent[i] == -1U) {
+			store_root(m, 1, local_to_world + 12 * i);
+		} else {
+			compose_sse2(local_to_world + 12 * soa.parent[i], m, 1, local_to_world + 12 * i);
+		}
+	}
+}
+
+void cull_boxes_sse2(uint32_t count, float const *cx, float const *cy, float const *cz, float const *ex, float const *ey, float const *ez,
+	float const planes[24], uint8_t *visible) {
+	uint32_t i = 0;
+	__m128 zero = _mm_setzero_ps();
+	for (; i + 4 <= count; i += 4) {
+		__m128 x = _mm_loadu_ps(cx + i), y = _mm_loadu_ps(cy + i), z = _mm_loadu_ps(cz + i);
+		__m128 hx = _mm_loadu_ps(ex + i), hy = _mm_loadu_ps(ey + i), hz = _mm_loadu_ps(ez + i);
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (uint32_t p = 0; p < 6; ++p) {
+			float const *plane = planes + 4 * p;
+			__m128 dist = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane[0]), x), _mm_mul_ps(_mm_set1_ps(plane[1]), y)), _mm_mul_ps(_mm_set1_ps(plane[2]), z)), _mm_set1_ps(plane[3]));
+			__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(std::abs(plane[0])), hx), _mm_mul_ps(_mm_set1_ps(std::abs(plane[1])), hy)), _mm_mul_ps(_mm_set1_ps(std::abs(plane[2])), hz));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(dist, radius), zero));
+		}
+		int bits = _mm_movemask_ps(inside);
+		for (uint32_t l = 0; l < 4; ++l) {
+			visible[i+l] = uint8_t((bits >> l) & 1);
+		}
+	}
+	cull_boxes_scalar(count - i, cx + i, cy + i, cz + i, ex + i, ey + i, ez + i, planes, visible + i);
+}
+
+TARGET_AVX2 void local_to_parent_avx2(TransformSoA const &soa, uint32_t i, float *block) {
+	__m256 x = _mm256_loadu_ps(soa.rotation[0] + i);
+	__m256 y = _mm256_loadu_ps(soa.rotation[1] + i);
+	__m256 z = _mm256_loadu_ps(soa.rotation[2] + i);
+	__m256 w = _mm256_loadu_ps(soa.rotation[3] + i);
+	__m256 sx = _mm256_loadu_ps(soa.scale[0] + i);
+	__m256 sy = _mm256_loadu_ps(soa.scale[1] + i);
+	__m256 sz = _mm256_loadu_ps(soa.scale[2] + i);
+	__m256 one = _mm256_set1_ps(1.0f);
+	__m256 two = _mm256_set1_ps(2.0f);
+
+	__m256 xx = _mm256_mul_ps(x, x), yy = _mm256_mul_ps(y, y), zz = _mm256_mul_ps(z, z);
+	__m256 xy = _mm256_mul_ps(x, y), xz = _mm256_mul_ps(x, z), yz = _mm256_mul_ps(y, z);
+	__m256 wx = _mm256_mul_ps(w, x), wy = _mm256_mul_ps(w, y), wz = _mm256_mul_ps(w, z);
+
+	_mm256_store_ps(block + 0*8, _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(yy, zz))), sx));
+	_mm256_store_ps(block + 1*8, _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xy, wz)), sx));
+	_mm256_store_ps(block + 2*8, _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xz, wy)), sx));
+	_mm256_store_ps(block + 3*8, _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xy, wz)), sy));
+	_mm256_store_ps(block + 4*8, _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, zz))), sy));
+	_mm256_store_ps(block + 5*8, _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(yz, wx)), sy));
+	_mm256_store_ps(block + 6*8, _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xz, wy)), sz));
+	_mm256_store_ps(block + 7*8, _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(yz, wx)), sz));
+	_mm256_store_ps(block + 8*8, _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, yy))), sz));
+	_mm256_store_ps(block + 9*8, _mm256_loadu_ps(soa.position[0] + i));
+	_mm256_store_ps(block + 10*8, _mm256_loadu_ps(soa.position[1] + i));
+	_mm256_store_ps(block + 11*8, _mm256_loadu_ps(soa.position[2] + i));
+}
+
+//same as the SSE2 version, but building eight local matrices at a time:
+TARGET_AVX2 void build_local_to_world_avx2(TransformSoA const &soa, uint32_t begin, uint32_t end, float *local_to_world) {
+	uint32_t i = begin;
+	alignas(32) float block[12 * 8];
+	for (; i + 8 <= end; i += 8) {
+		local_to_parent_avx2(soa, i, block);
+		for (uint32_t l = 0; l < 8; ++l) {
+			if (soa.parent[i+l] == -1U) {
+				store_root(block + l, 8, local_to_world + 12 * (i+l));
+			} else {
+				compose_sse2(local_to_world + 12 * soa.parent[i+l], block + l, 8, local_to_world + 12 * (i+l));
+			}
+		}
+	}
+	build_local_to_world_sse2(soa, i, end, local_to_world);
+}
+
+TARGET_AVX2 void cull_boxes_avx2(uint32_t count, float const *cx, float const *cy, float const *cz, float const *ex, float const *ey, float const *ez,
+	float const planes[24], uint8_t *visible) {
+	uint32_t i = 0;
+	__m256 zero = _mm256_setzero_ps();
+	for (; i + 8 <= count; i += 8) {
+		__m256 x = _mm256_loadu_ps(cx + i), y = _mm256_loadu_ps(cy + i), z = _mm256_loadu_ps(cz + i);
+		__m256 hx = _mm256_loadu_ps(ex + i), hy = _mm256_loadu_ps(ey + i), hz = _mm256_loadu_ps(ez + i);
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (uint32_t p = 0; p < 6; ++p) {
+			float const *plane = planes + 4 * p;
+			__m256 dist = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane[0]), x), _mm256_mul_ps(_mm256_set1_ps(plane[1]), y)), _mm256_mul_ps(_mm256_set1_ps(plane[2]), z)), _mm256_set1_ps(plane[3]));
+			__m256 radius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(std::abs(plane[0])), hx), _mm256_mul_ps(_mm256_set1_ps(std::abs(plane[1])), hy)), _mm256_mul_ps(_mm256_set1_ps(std::abs(plane[2])), hz));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(dist, radius), zero, _CMP_GE_OQ));
+		}
+		int bits = _mm256_movemask_ps(inside);
+		for (uint32_t l = 0; l < 8; ++l) {
+			visible[i+l] = uint8_t((bits >> l) & 1);
+		}
+	}
+	cull_boxes_sse2(count - i, cx + i, cy + i, cz + i, ex + i, ey + i, ez + i, planes, visible + i);
+}
+
+#endif //TRANSFORM_KERNELS_X86
+
+struct Kernels {
+	char const *name;
+	void (*build_local_to_world)(TransformSoA const &, uint32_t, uint32_t, float *);
+	void (*cull_boxes)(uint32_t, float const *, float const *, float const *, float const *, float const *, float const *, float const[24], uint8_t *);
+};
+
+Kernels choose_kernels() {
+	#ifdef TRANSFORM_KERNELS_X86
+	if (SDL_HasAVX2()) {
+		return Kernels{ "avx2", build_local_to_world_avx2, cull_boxes_avx2 };
+	}
+	if (SDL_HasSSE2()) {
+		return Kernels{ "sse2", build_local_to_world_sse2, cull_boxes_sse2 };
+	}
+	#endif
+	return Kernels{ "scalar", build_local_to_world_scalar, cull_boxes_scalar };
+}
+
+Kernels const kernels = choose_kernels();
+
+}
+
+void build_local_to_world(TransformSoA const &soa, uint32_t begin, uint32_t end, float *local_to_world) {
+	kernels.build_local_to_world(soa, begin, end, local_to_world);
+}
+
+void cull_boxes(uint32_t count, float const *cx, float const *cy, float const *cz, float const *ex, float const *ey, float const *ez,
+	float const planes[24], uint8_t *visible) {
+	kernels.cull_boxes(count, cx, cy, cz, ex, ey, ez, planes, visible);
+}
+
+char const *transform_kernel_name() {
+	return kernels.name;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+
+//Batched kernels used by Scene: world matrices for packed (structure-of-arrays) transforms, and view culling.
+//As with mix_kernels, the best available implementation (AVX2, SSE2, or plain scalar code)
+// is picked once, at startup, based on what the CPU reports it supports.
+
+//Transform data as structure-of-arrays, one entry per transform:
+struct TransformSoA {
+	float const *position[3]; //x, y, z
+	float const *rotation[4]; //unit quaternion x, y, z, w
+	float const *scale[3]; //x, y, z
+	uint32_t const *parent; //index of parent transform (always less than own index), or -1U for none
+};
+
+//Build local-to-world matrices for transforms [begin, end) of 'soa' into 'local_to_world'
+// (12 floats per transform, laid out like glm::mat4x3: four columns of x, y, z):
+//  local_to_parent = translate(position) * rotate(rotation) * scale(scale)
+//  local_to_world[i] = local_to_world[parent[i]] * local_to_parent[i]  (or just local_to_parent[i] for roots)
+// entries before 'begin' must already be up to date, since parents come before their children.
+void build_local_to_world(TransformSoA const &soa, uint32_t begin, uint32_t end, float *local_to_world);
+
+//Test 'count' world-space boxes, given as structure-of-arrays centers (cx, cy, cz) and half-extents (ex, ey, ez),
+// against six planes (plane p is planes[4p+0..3] = (nx, ny, nz, d), with the inside where dot(n, x) + d >= 0):
+//  visible[i] = 1 if box i reaches the inside of every plane, otherwise 0
+// (conservative: boxes near a corner of the frustum may be kept even if they don't touch it)
+void cull_boxes(uint32_t count, float const *cx, float const *cy, float const *cz, float const *ex, float const *ey, float const *ez,
+	float const planes[24], uint8_t *visible);
+
+//Name of the kernel variant in use (handy for logging / benchmarks):
+char const *transform_kernel_name();